@@ -0,0 +1,425 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include "Stats.hpp"
+#include "MinMaxIndex.hpp"
+#include "PercentileHistory.hpp"
+#include "OrderStatisticIndex.hpp"
+#include "FenwickIndex.hpp"
+
+/*
+ * Micro-benchmarks for Stats
+ * Each benchmark is run several times, and we report the median and the
+ * median absolute deviation (MAD) of the per-operation time, so that the
+ * comparison against a baseline (see bench/compare.awk) can tell noise
+ * from regressions.
+ *
+ * Usage: bench [repeats]
+ * Results are written on stdout as JSON, one benchmark per line.
+ */
+
+#define ADD_SAMPLES     1000000
+#define ADD_PER_SECOND  10000
+#define ADD_BATCH       40
+#define ADD_BUDGET      1000
+#define WINDOW_SAMPLES  10000
+#define GETP_LOOPS      5
+#define SPARSE_PERIOD   100
+#define SPARSE_SAMPLES  10
+#define SPARSE_LOOPS    1000
+#define DEFAULT_REPEATS 15
+
+/*
+ * benchmark values are in [0, 1[, quantized to 2^-16 for the Fenwick tree
+ */
+#define FENWICK_INDEX   fr_benou::FenwickIndex<double, BenchClock::timestamp_type>(0, 1, 1.0 / 65536)
+
+/*
+ * Fake clock, so that the benchmarks do not depend on the wall clock and
+ * always fill the whole window
+ */
+struct BenchClock {
+    typedef std::uint64_t timestamp_type;
+    static timestamp_type now;
+    timestamp_type operator() (void) const { return now; }
+};
+BenchClock::timestamp_type BenchClock::now = 1000000000;
+
+typedef fr_benou::Stats<double, 60, BenchClock> BenchStats;
+typedef fr_benou::Stats<int, 60, BenchClock> IntBenchStats;
+typedef fr_benou::Stats<double, 3600, BenchClock> LongBenchStats;
+typedef fr_benou::Stats<double, 60, BenchClock,
+        fr_benou::MinMaxIndex<double, BenchClock::timestamp_type>> MinMaxBenchStats;
+typedef fr_benou::Stats<double, 60, BenchClock,
+        fr_benou::PercentileHistory<double, 3600, 50, 70, 99>> HistoryBenchStats;
+typedef fr_benou::Stats<double, 60, BenchClock,
+        fr_benou::OrderStatisticIndex<double, 60, BenchClock::timestamp_type>> OrderBenchStats;
+typedef fr_benou::Stats<double, 60, BenchClock,
+        fr_benou::FenwickIndex<double, BenchClock::timestamp_type>> FenwickBenchStats;
+typedef fr_benou::Stats<float, 60, BenchClock> FloatBenchStats;
+typedef fr_benou::Stats<float, 60, BenchClock, fr_benou::NoIndex,
+        fr_benou::CompactStorage> CompactBenchStats;
+typedef std::chrono::steady_clock bench_clock;
+
+/*
+ * pseudo-random values, cheap and reproducible across runs
+ */
+static double next_value(std::uint32_t& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) * (1.0 / (1 << 24));
+}
+
+static void fill(BenchStats& stats, int seconds, int per_second)
+{
+    std::uint32_t seed = 42;
+    for (int i=0; i<seconds; ++i) {
+        BenchClock::now++;
+        for (int j=0; j<per_second; ++j) {
+            stats.add(next_value(seed));
+        }
+    }
+}
+
+/*
+ * @return: ns per add()
+ */
+static double bench_add()
+{
+    BenchStats stats;
+    std::uint32_t seed = 1;
+    std::vector<double> values(ADD_SAMPLES);
+    for (auto& v : values) v = next_value(seed);
+
+    auto start = bench_clock::now();
+    for (int i=0; i<ADD_SAMPLES; ++i) {
+        if (0 == i % ADD_PER_SECOND) BenchClock::now++;
+        stats.add(values[i]);
+    }
+    auto stop = bench_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / ADD_SAMPLES;
+}
+
+/*
+ * @return: ns per add() through a Stats::Writer
+ */
+static double bench_writer_add()
+{
+    BenchStats stats;
+    BenchStats::Writer writer = stats.writer();
+    std::uint32_t seed = 1;
+    std::vector<double> values(ADD_SAMPLES);
+    for (auto& v : values) v = next_value(seed);
+
+    auto start = bench_clock::now();
+    for (int i=0; i<ADD_SAMPLES; ++i) {
+        if (0 == i % ADD_PER_SECOND) BenchClock::now++;
+        writer.add(values[i]);
+    }
+    auto stop = bench_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / ADD_SAMPLES;
+}
+
+/*
+ * @return: ns per value for add(first, last) with ADD_BATCH values batches
+ */
+static double bench_add_batch()
+{
+    BenchStats stats;
+    std::uint32_t seed = 1;
+    std::vector<double> values(ADD_SAMPLES);
+    for (auto& v : values) v = next_value(seed);
+
+    auto start = bench_clock::now();
+    for (int i=0; i<ADD_SAMPLES; i+=ADD_BATCH) {
+        if (0 == i % ADD_PER_SECOND) BenchClock::now++;
+        stats.add(&values[i], &values[i] + ADD_BATCH);
+    }
+    auto stop = bench_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / ADD_SAMPLES;
+}
+
+/*
+ * @return: ns per add() with a budget of ADD_BUDGET values per second, ie
+ *          sampling 10% of the values
+ */
+static double bench_add_sampled()
+{
+    BenchStats stats;
+    stats.set_budget(ADD_BUDGET);
+    std::uint32_t seed = 1;
+    std::vector<double> values(ADD_SAMPLES);
+    for (auto& v : values) v = next_value(seed);
+
+    auto start = bench_clock::now();
+    for (int i=0; i<ADD_SAMPLES; ++i) {
+        if (0 == i % ADD_PER_SECOND) BenchClock::now++;
+        stats.add(values[i]);
+    }
+    auto stop = bench_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / ADD_SAMPLES;
+}
+
+/*
+ * @return: ns per add() for a Stats type
+ */
+template <typename S>
+static double bench_add_indexed(const typename S::index_type& index = typename S::index_type())
+{
+    S stats(index);
+    std::uint32_t seed = 1;
+    std::vector<double> values(ADD_SAMPLES);
+    for (auto& v : values) v = next_value(seed);
+
+    auto start = bench_clock::now();
+    for (int i=0; i<ADD_SAMPLES; ++i) {
+        if (0 == i % ADD_PER_SECOND) BenchClock::now++;
+        stats.add(values[i]);
+    }
+    auto stop = bench_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / ADD_SAMPLES;
+}
+
+/*
+ * @return: ns per element for a get_p() on a full window
+ */
+static double bench_get_p(int p)
+{
+    static BenchStats stats;
+    static bool filled = false;
+    if (!filled) {
+        fill(stats, 60, WINDOW_SAMPLES);
+        filled = true;
+    }
+
+    double sink = 0;
+    auto start = bench_clock::now();
+    for (int i=0; i<GETP_LOOPS; ++i) {
+        sink += stats.get_p(p);
+    }
+    auto stop = bench_clock::now();
+    if (sink < 0) std::cerr << sink;
+    return std::chrono::duration<double, std::nano>(stop - start).count()
+        / (GETP_LOOPS * 60.0 * WINDOW_SAMPLES);
+}
+
+/*
+ * @return: ns per get_p() on a full window maintained in an index,
+ *          alternating with add() as when the percentile is queried after
+ *          every value
+ */
+template <typename S>
+static double bench_add_get_p(int p, const typename S::index_type& index = typename S::index_type())
+{
+    static S stats(index);
+    static bool filled = false;
+    static std::uint32_t seed = 42;
+    if (!filled) {
+        for (int i=0; i<60; ++i) {
+            BenchClock::now++;
+            for (int j=0; j<WINDOW_SAMPLES; ++j) stats.add(next_value(seed));
+        }
+        filled = true;
+    }
+
+    double sink = 0;
+    auto start = bench_clock::now();
+    for (int i=0; i<WINDOW_SAMPLES; ++i) {
+        stats.add(next_value(seed));
+        sink += stats.get_p(p);
+    }
+    auto stop = bench_clock::now();
+    if (sink < 0) std::cerr << sink;
+    return std::chrono::duration<double, std::nano>(stop - start).count() / WINDOW_SAMPLES;
+}
+
+/*
+ * @return: ns per element for a get_p() on a full window of integers
+ */
+static double bench_get_p_int(int p)
+{
+    static IntBenchStats stats;
+    static bool filled = false;
+    if (!filled) {
+        std::uint32_t seed = 42;
+        for (int i=0; i<60; ++i) {
+            BenchClock::now++;
+            for (int j=0; j<WINDOW_SAMPLES; ++j) {
+                stats.add(int(next_value(seed) * 1000000));
+            }
+        }
+        filled = true;
+    }
+
+    long sink = 0;
+    auto start = bench_clock::now();
+    for (int i=0; i<GETP_LOOPS; ++i) {
+        sink += stats.get_p(p);
+    }
+    auto stop = bench_clock::now();
+    if (sink < 0) std::cerr << sink;
+    return std::chrono::duration<double, std::nano>(stop - start).count()
+        / (GETP_LOOPS * 60.0 * WINDOW_SAMPLES);
+}
+
+/*
+ * @return: ns per element for iterating over a long window where only one
+ *          second out of SPARSE_PERIOD has values
+ */
+static double bench_iterate_sparse()
+{
+    static LongBenchStats stats;
+    static bool filled = false;
+    if (!filled) {
+        std::uint32_t seed = 42;
+        for (int i=0; i<3600; ++i) {
+            BenchClock::now++;
+            if (0 == i % SPARSE_PERIOD) {
+                for (int j=0; j<SPARSE_SAMPLES; ++j) stats.add(next_value(seed));
+            }
+        }
+        filled = true;
+    }
+
+    double sink = 0;
+    auto start = bench_clock::now();
+    for (int i=0; i<SPARSE_LOOPS; ++i) {
+        for (const auto& sp : stats) sink += sp.second;
+    }
+    auto stop = bench_clock::now();
+    if (sink < 0) std::cerr << sink;
+    return std::chrono::duration<double, std::nano>(stop - start).count()
+        / (SPARSE_LOOPS * 3600.0 / SPARSE_PERIOD * SPARSE_SAMPLES);
+}
+
+/*
+ * @return: buckets bytes per element for a full window of floats
+ */
+template <typename S>
+static double bench_memory()
+{
+    S stats;
+    std::uint32_t seed = 42;
+    for (int i=0; i<60; ++i) {
+        BenchClock::now++;
+        for (int j=0; j<WINDOW_SAMPLES; ++j) stats.add(float(next_value(seed)));
+    }
+    return double(stats.memory()) / stats.size();
+}
+
+/*
+ * @return: ns per element for a get_p() on a full window of floats stored
+ *          compactly, the (timestamp, value) pairs being rebuilt on the fly
+ */
+static double bench_get_p_compact(int p)
+{
+    static CompactBenchStats stats;
+    static bool filled = false;
+    if (!filled) {
+        std::uint32_t seed = 42;
+        for (int i=0; i<60; ++i) {
+            BenchClock::now++;
+            for (int j=0; j<WINDOW_SAMPLES; ++j) stats.add(float(next_value(seed)));
+        }
+        filled = true;
+    }
+
+    double sink = 0;
+    auto start = bench_clock::now();
+    for (int i=0; i<GETP_LOOPS; ++i) {
+        sink += stats.get_p(p);
+    }
+    auto stop = bench_clock::now();
+    if (sink < 0) std::cerr << sink;
+    return std::chrono::duration<double, std::nano>(stop - start).count()
+        / (GETP_LOOPS * 60.0 * WINDOW_SAMPLES);
+}
+
+/*
+ * @return: ns per element of the full window for a Stats snapshot
+ */
+static double bench_snapshot()
+{
+    static BenchStats stats;
+    static bool filled = false;
+    if (!filled) {
+        fill(stats, 60, WINDOW_SAMPLES);
+        filled = true;
+    }
+
+    BenchStats::size_type sink = 0;
+    auto start = bench_clock::now();
+    for (int i=0; i<GETP_LOOPS; ++i) {
+        BenchStats snapshot = stats.snapshot();
+        sink += snapshot.size();
+    }
+    auto stop = bench_clock::now();
+    if (0 == sink) std::cerr << sink;
+    return std::chrono::duration<double, std::nano>(stop - start).count()
+        / (GETP_LOOPS * 60.0 * WINDOW_SAMPLES);
+}
+
+static double median(std::vector<double> v)
+{
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+/*
+ * run a benchmark @repeats times and print its JSON summary
+ */
+template <typename F>
+static void run(const std::string& name, const std::string& unit, int repeats, F f, bool last)
+{
+    std::vector<double> samples;
+    f(); /* warm-up */
+    for (int i=0; i<repeats; ++i) {
+        samples.push_back(f());
+    }
+    double med = median(samples);
+    std::vector<double> dev;
+    for (double s : samples) dev.push_back(std::fabs(s - med));
+    double mad = median(dev);
+
+    std::cout << "  {\"name\": \"" << name << "\", \"unit\": \"" << unit
+        << "\", \"repeats\": " << repeats
+        << ", \"median\": " << med << ", \"mad\": " << mad << "}"
+        << (last ? "" : ",") << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int repeats = argc > 1 ? std::atoi(argv[1]) : DEFAULT_REPEATS;
+    if (repeats <= 0) repeats = DEFAULT_REPEATS;
+
+    std::cout << "{\"benchmarks\": [" << std::endl;
+    run("add", "ns/op", repeats, bench_add, false);
+    run("writer_add", "ns/op", repeats, bench_writer_add, false);
+    run("add_batch", "ns/op", repeats, bench_add_batch, false);
+    run("add_sampled", "ns/op", repeats, bench_add_sampled, false);
+    run("add_minmax", "ns/op", repeats, []{ return bench_add_indexed<MinMaxBenchStats>(); }, false);
+    run("add_history", "ns/op", repeats, []{ return bench_add_indexed<HistoryBenchStats>(); }, false);
+    run("get_p70", "ns/elem", repeats, []{ return bench_get_p(70); }, false);
+    run("get_p99", "ns/elem", repeats, []{ return bench_get_p(99); }, false);
+    run("add_order", "ns/op", repeats, []{ return bench_add_indexed<OrderBenchStats>(); }, false);
+    run("add_get_p70_order", "ns/op", repeats, []{ return bench_add_get_p<OrderBenchStats>(70); }, false);
+    run("add_fenwick", "ns/op", repeats,
+            []{ return bench_add_indexed<FenwickBenchStats>(FENWICK_INDEX); }, false);
+    run("add_get_p70_fenwick", "ns/op", repeats,
+            []{ return bench_add_get_p<FenwickBenchStats>(70, FENWICK_INDEX); }, false);
+    run("get_p70_int", "ns/elem", repeats, []{ return bench_get_p_int(70); }, false);
+    run("iterate_sparse", "ns/elem", repeats, bench_iterate_sparse, false);
+    run("get_p70_compact", "ns/elem", repeats, []{ return bench_get_p_compact(70); }, false);
+    run("memory_float", "B/elem", repeats, bench_memory<FloatBenchStats>, false);
+    run("memory_float_compact", "B/elem", repeats, bench_memory<CompactBenchStats>, false);
+    run("snapshot", "ns/elem", repeats, bench_snapshot, true);
+    std::cout << "]}" << std::endl;
+
+    return 0;
+}
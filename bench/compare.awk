@@ -0,0 +1,52 @@
+# Compare a benchmark run against a baseline, both produced by bench/bench
+#
+# Usage: awk -v tolerance=0.10 -v nsigma=3 -f compare.awk baseline.json current.json
+#
+# A benchmark regresses when its median grows by more than
+#   max(tolerance * baseline median, nsigma * 1.4826 * max(baseline MAD, current MAD))
+# 1.4826 * MAD estimates the standard deviation, so that noisy benchmarks
+# get a wider margin than stable ones.
+# Exits with 1 if any benchmark regressed. Benchmarks missing from the
+# baseline are reported but do not fail the comparison.
+
+function field(line, key,    re) {
+    re = "\"" key "\": *\"?[^,}\"]*"
+    if (!match(line, re)) return ""
+    line = substr(line, RSTART, RLENGTH)
+    sub("\"" key "\": *\"?", "", line)
+    return line
+}
+
+BEGIN {
+    if (tolerance == "") tolerance = 0.10
+    if (nsigma == "") nsigma = 3
+}
+
+/"name":/ {
+    name = field($0, "name")
+    if (FNR == NR) {
+        base_median[name] = field($0, "median")
+        base_mad[name] = field($0, "mad")
+        next
+    }
+    unit = field($0, "unit")
+    median = field($0, "median")
+    mad = field($0, "mad")
+    if (!(name in base_median)) {
+        printf "%-12s %10.3f %-8s (no baseline)\n", name, median, unit
+        next
+    }
+    noise = nsigma * 1.4826 * (base_mad[name] > mad ? base_mad[name] : mad)
+    margin = tolerance * base_median[name]
+    if (noise > margin) margin = noise
+    delta = median - base_median[name]
+    status = delta > margin ? "REGRESSION" : "ok"
+    if (delta > margin) failed = 1
+    printf "%-12s %10.3f -> %10.3f %-8s (%+.1f%%, margin %.3f) %s\n", \
+        name, base_median[name], median, unit, \
+        base_median[name] ? 100 * delta / base_median[name] : 0, margin, status
+}
+
+END {
+    if (failed) exit 1
+}
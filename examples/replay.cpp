@@ -0,0 +1,204 @@
+#include <iostream>
+#include <ratio>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "Stats.hpp"
+#include "IntervalStats.hpp"
+#include "MinMaxIndex.hpp"
+#include "MeanIndex.hpp"
+#include "PercentileHistory.hpp"
+#include "OrderStatisticIndex.hpp"
+#include "FenwickIndex.hpp"
+#include "TieredStats.hpp"
+#include "utils.hpp"
+
+/*
+ * Replay "timestamp value" lines from stdin into Stats, then print several
+ * percentiles computed through the different query paths, one percentile
+ * per line:
+ *     p<percentile> <get_p(p)> <get_p<p>()> <record get_p(p, field)> <record get_p<p>(field)>
+ *         <int get_p(p)> <compact get_p(p)> <indexed get_p(p)> <indexed get_p<p>()>
+ *         <int indexed get_p(p)>
+ * The output starts with the number of elements, first counted by size()
+ * then by a reverse iteration, and the values of the 5 newest elements:
+ *     size <size()> <rbegin() to rend() count> <compact size()> <compact begin() to end() count>
+ *     last <last(5) values>
+ *     min <min()> <indexed min()> <indexed min() of the input added backward> <compact min()>
+ *     max <max()> <indexed max()> <indexed max() of the input added backward> <compact max()>
+ *     mean10 <mean_over(10)> <indexed mean_over(10)> <compact mean_over(10)>
+ *     mismatches <number of times the indexed extrema differed from max() and min() during replay>
+ *     sampled <sampling rate> <size()> <get_p(50)> <get_p<99>()>, with a budget of 30 values per second
+ *     tiered <percentile> <TieredStats get_p()> <error bound>
+ * then the per-second percentiles history, oldest first:
+ *     h <timestamp> <p0> <p50> <p70> <p100>
+ * and ends with the 0, 70 and 100-percentiles of all the values, without
+ * expiry, from IntervalStats:
+ *     all <size()> <get_p<0>()> <get_p(70)> <get_p<100>()>
+ */
+
+typedef fr_benou::Stats<double, 60> ReplayStats;
+
+/*
+ * a record holding the value, to check projections
+ */
+struct Record {
+    std::uint64_t seq;
+    double value;
+    int status;
+};
+typedef fr_benou::Stats<Record, 60> RecordStats;
+
+/*
+ * integral values are selected by counting instead of comparison
+ */
+typedef fr_benou::Stats<int, 60> IntStats;
+
+/*
+ * window extrema and buckets sums maintained on add()
+ */
+typedef fr_benou::Stats<double, 60, fr_benou::GetTimestamp,
+        fr_benou::IndexSet<fr_benou::MinMaxIndex<double>, fr_benou::MeanIndex<double, 60>>> MinMaxStats;
+
+/*
+ * percentiles computed per second as buckets are sealed, with a history
+ * longer than the window
+ */
+typedef fr_benou::Stats<double, 60, fr_benou::GetTimestamp,
+        fr_benou::PercentileHistory<double, 3600, 0, 50, 70, 100>> HistoryStats;
+
+/*
+ * timestamps stored once per bucket instead of once per value
+ */
+typedef fr_benou::Stats<float, 60, fr_benou::GetTimestamp, fr_benou::NoIndex,
+        fr_benou::CompactStorage> CompactStats;
+
+/*
+ * percentiles found in the order-statistic tree maintained on add()
+ */
+typedef fr_benou::Stats<double, 60, fr_benou::GetTimestamp,
+        fr_benou::OrderStatisticIndex<double, 60>> OrderedStats;
+
+/*
+ * percentiles of integers found in a Fenwick tree over [0, 999]
+ */
+typedef fr_benou::Stats<int, 60, fr_benou::GetTimestamp, fr_benou::FenwickIndex<int>> FenwickStats;
+
+/*
+ * exact values for the last 5 seconds, sketches for the older ones
+ */
+typedef fr_benou::TieredStats<double, 60, 5> ReplayTieredStats;
+
+template <int P>
+static void print_p(const ReplayStats& stats, const RecordStats& records, const IntStats& ints,
+        const CompactStats& compact, const OrderedStats& ordered, const FenwickStats& fenwick)
+{
+    std::cout << "p" << P << " " << stats.get_p(P) << " " << stats.get_p<P>()
+        << " " << records.get_p(P, &Record::value)
+        << " " << records.get_p<P>([](const Record& r) { return r.value; })
+        << " " << ints.get_p(P) << " " << compact.get_p(P)
+        << " " << ordered.get_p(P) << " " << ordered.get_p<P>()
+        << " " << fenwick.get_p(P) << std::endl;
+}
+
+int main()
+{
+    ReplayStats stats;
+    RecordStats records;
+    IntStats ints;
+    fr_benou::IntervalStats<double> intervals;
+    MinMaxStats minmax;
+    HistoryStats history;
+    ReplayTieredStats tiered;
+    ReplayStats sampled;
+    sampled.set_budget(30);
+    CompactStats compact;
+    OrderedStats ordered;
+    FenwickStats fenwick(fr_benou::FenwickIndex<int>(0, 999));
+    std::vector<std::pair<std::uint64_t, double>> input;
+    std::uint64_t ts;
+    double val;
+    std::uint64_t seq = 0;
+    std::uint64_t newest = 0;
+    int mismatches = 0;
+    while (std::cin >> ts >> val) {
+        newest = ts;
+        stats.add(ts, val);
+        records.emplace_at(ts, seq++, val, 200);
+        ints.add(ts, int(val));
+        intervals.add(val);
+        minmax.add(ts, val);
+        history.add(ts, val);
+        tiered.add(ts, val);
+        sampled.add(ts, val);
+        compact.add(ts, float(val));
+        ordered.add(ts, val);
+        fenwick.add(ts, int(val));
+        input.emplace_back(ts, val);
+        if (minmax.min() != stats.min() || minmax.max() != stats.max()) ++mismatches;
+    }
+
+    /*
+     * adding the input backward makes every value but the first a late one
+     */
+    MinMaxStats backward;
+    for (auto it = input.rbegin(); it != input.rend(); ++it) backward.add(*it);
+
+    /*
+     * copies share buckets with stats: writing to them must not change stats
+     */
+    ReplayStats copy = stats.snapshot();
+    for (int i=0; i<100; ++i) copy.add(newest - i % 3, -1);
+    ReplayStats copy2(copy);
+    copy2.clear();
+
+    ReplayStats::size_type count = 0;
+    for (auto it = stats.rbegin(); it != stats.rend(); ++it) ++count;
+    CompactStats::size_type compact_count = 0;
+    for (auto it = compact.begin(); it != compact.end(); ++it) ++compact_count;
+    std::cout << "size " << stats.size() << " " << count << " " << compact.size() << " "
+        << compact_count << std::endl;
+
+    std::cout << "last";
+    for (const auto& sp : stats.last(5)) std::cout << " " << sp.second;
+    std::cout << std::endl;
+
+    std::cout << "min " << stats.min() << " " << minmax.min() << " " << backward.min() << " "
+        << compact.min() << std::endl;
+    std::cout << "max " << stats.max() << " " << minmax.max() << " " << backward.max() << " "
+        << compact.max() << std::endl;
+
+    std::cout << "mean10 " << stats.mean_over(10) << " " << minmax.mean_over(10) << " "
+        << compact.mean_over(10) << std::endl;
+    std::cout << "mismatches " << mismatches << std::endl;
+    std::cout << "sampled " << sampled.sampling_rate() << " " << sampled.size() << " "
+        << sampled.get_p(50) << " " << sampled.get_p<99>() << std::endl;
+    for (int p : {0, 1, 50, 70, 99, 100}) {
+        auto estimate = tiered.get_p(p);
+        std::cout << "tiered " << p << " " << estimate.value << " " << estimate.error << std::endl;
+    }
+
+    std::vector<HistoryStats::index_type::Point> points(history.index().size());
+    points.resize(history.index().last(points.data(), points.size()));
+    for (const auto& point : points) {
+        std::cout << "h " << point.ts;
+        for (double p : point.p) std::cout << " " << p;
+        std::cout << std::endl;
+    }
+
+    print_p<0>(stats, records, ints, compact, ordered, fenwick);
+    print_p<1>(stats, records, ints, compact, ordered, fenwick);
+    print_p<5>(stats, records, ints, compact, ordered, fenwick);
+    print_p<50>(stats, records, ints, compact, ordered, fenwick);
+    print_p<70>(stats, records, ints, compact, ordered, fenwick);
+    print_p<95>(stats, records, ints, compact, ordered, fenwick);
+    print_p<99>(stats, records, ints, compact, ordered, fenwick);
+    print_p<100>(stats, records, ints, compact, ordered, fenwick);
+    std::cout << "p99.9 " << stats.get_p<std::ratio<999, 10>>() << std::endl;
+
+    auto all = intervals.get_and_reset();
+    std::cout << "all " << all.size() << " " << all.get_p<0>() << " " << all.get_p(70)
+        << " " << all.get_p<100>() << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+#include "Stats.hpp"
+
+#ifndef FR_BENOU_FENWICK_INDEX_H_
+#define FR_BENOU_FENWICK_INDEX_H_
+
+namespace fr_benou {
+
+    /*
+     * Stats index counting the values of the window per value in a Fenwick
+     * tree, for values in a bounded range: integers, or values quantized to
+     * a step. Any percentile is then found in O(log V), V being the number
+     * of distinct values of the range, with no per-value memory:
+     *     typedef Stats<int, 60, GetTimestamp, FenwickIndex<int>> StatusStats;
+     *     StatusStats stats(FenwickIndex<int>(100, 599));
+     *     int p99 = stats.get_p(99);  // O(log V)
+     *
+     * Values out of the range are counted as its bounds. Quantized values
+     * are reported as the lower bound of their step.
+     * The index forgets the values of a bucket when it expires: it must not
+     * be combined with a budget (see Stats::set_budget()), as the values
+     * dropped by the sampling would never be forgotten.
+     *
+     * Template parameters:
+     * @T: the value type, convertible from and to size_type
+     * @TS: the timestamp type
+     */
+    template <typename T, typename TS=GetTimestamp::timestamp_type>
+    class FenwickIndex {
+        /*
+         * @size_type: a type large enough to count the values of the window
+         */
+        public:
+            typedef std::uint32_t size_type;
+
+        /*
+         * @lo, @step: the value of the first bin, and the width of the bins
+         * @bins: number of bins
+         * @top: highest power of 2 not above @bins, to descend the tree
+         * @tree: Fenwick tree of the bins counts, 1-based
+         * @counts: the bins counts, to rebuild the tree after large expiries
+         * @total: number of values
+         */
+        private:
+            T lo;
+            T step;
+            size_type bins;
+            size_type top;
+            std::vector<size_type> tree;
+            std::vector<size_type> counts;
+            size_type total;
+
+            /*
+             * @return: the bin of a value
+             */
+            size_type bin_(const T& val) const
+            {
+                if (val < lo) return 0;
+                size_type i = size_type((val - lo) / step);
+                return i < bins ? i : bins - 1;
+            }
+
+            /*
+             * add @delta to the count of bin @i, and to the tree nodes
+             * covering it
+             *
+             * @complexity: O(log V)
+             */
+            void update_(size_type i, size_type delta)
+            {
+                counts[i] += delta;
+                for (++i; i <= bins; i += i & -i) tree[i] += delta;
+            }
+
+            /*
+             * rebuild the tree from the bins counts
+             *
+             * @complexity: O(V)
+             */
+            void rebuild_()
+            {
+                for (size_type i=1; i<=bins; ++i) tree[i] = counts[i - 1];
+                for (size_type i=1; i<=bins; ++i) {
+                    size_type parent = i + (i & -i);
+                    if (parent <= bins) tree[parent] += tree[i];
+                }
+            }
+
+        public:
+            /*
+             * @lo, @hi: range of the values, bounds included
+             * @step: width of the bins, 1 for exact integers
+             *
+             * @throw: std::invalid_argument when the range is empty or
+             *         @step is not positive
+             */
+            FenwickIndex(T lo, T hi, T step = T(1)) : lo(lo), step(step), total(0)
+            {
+                if (!(T(0) < step) || hi < lo) throw std::invalid_argument("invalid FenwickIndex range");
+                bins = size_type((hi - lo) / step) + 1;
+                for (top = 1; top <= bins / 2; top *= 2) {}
+                tree.assign(bins + 1, 0);
+                counts.assign(bins, 0);
+            }
+
+            void insert(TS, const T& val)
+            {
+                update_(bin_(val), 1);
+                ++total;
+            }
+
+            template <typename It>
+            void seal(TS, It, It) {}
+
+            /*
+             * subtract the values of an expired bucket
+             * Large buckets are subtracted from the bins counts in one pass,
+             * and the tree is then rebuilt, rather than updated per value
+             *
+             * @complexity: O(min(k*log(V), k+V)), k being the number of
+             *              values of the bucket
+             */
+            template <typename It>
+            void expire(TS, It first, It last)
+            {
+                size_type k = size_type(std::distance(first, last));
+                size_type depth = 0;
+                for (size_type b = bins; b; b >>= 1) ++depth;
+                if (k * depth < bins) {
+                    for (; first != last; ++first) update_(bin_(*first), size_type(-1));
+                } else {
+                    for (; first != last; ++first) --counts[bin_(*first)];
+                    rebuild_();
+                }
+                total -= k;
+            }
+
+            void clear()
+            {
+                std::fill(tree.begin(), tree.end(), 0);
+                std::fill(counts.begin(), counts.end(), 0);
+                total = 0;
+            }
+
+            /*
+             * @return: number of values in the window
+             */
+            size_type size() const
+            {
+                return total;
+            }
+
+            /*
+             * get the k-th smallest value of the window
+             *
+             * @k: 0-based rank
+             *
+             * @return: value, the lower bound of its step
+             * @throw: std::out_of_range when @k is not less than size()
+             * @complexity: O(log V)
+             */
+            T select(size_type k) const
+            {
+                if (k >= total) throw std::out_of_range("FenwickIndex rank out of range");
+                size_type pos = 0;
+                for (size_type bit = top; bit; bit >>= 1) {
+                    if (pos + bit <= bins && tree[pos + bit] <= k) {
+                        pos += bit;
+                        k -= tree[pos];
+                    }
+                }
+                return lo + T(pos) * step;
+            }
+    };
+
+}
+
+#endif  /* FR_BENOU_FENWICK_INDEX_H_ */
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <ratio>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "Stats.hpp"
+
+#ifndef FR_BENOU_INTERVAL_STATS_H_
+#define FR_BENOU_INTERVAL_STATS_H_
+
+namespace fr_benou {
+
+    /*
+     * Lock doing nothing, for single-threaded IntervalStats
+     */
+    struct NullLock {
+        void lock() {}
+        void unlock() {}
+    };
+
+    /*
+     * IntervalStats: store values since the last get_and_reset() call
+     * Unlike Stats, there is no sliding window: each get_and_reset() returns
+     * all the values added since the previous one ("percentiles since my
+     * last scrape"), and starts a new interval.
+     * Storage is pooled: get_and_reset() swaps the active storage for a
+     * recycled one in O(1), and the returned Interval gives its storage back
+     * to the pool once destroyed.
+     *
+     * Template parameters:
+     * @T: the value type
+     * @LOCK: lock protecting the active storage. NullLock (default) for a
+     *        single thread, std::mutex for concurrent add() and
+     *        get_and_reset(). Only the O(1) swap is done under the lock
+     * @GETTIMESTAMP: Callable functor returning the current timestamp when called
+     */
+    template <typename T=double, typename LOCK=NullLock, typename GETTIMESTAMP=GetTimestamp>
+    class IntervalStats {
+        /*
+         * @timestamp_type: timestamp values type
+         * @value_type: stored values type
+         * @size_type: a type large enough to count all stored elements
+         */
+        public:
+            typedef typename GETTIMESTAMP::timestamp_type timestamp_type;
+            typedef T value_type;
+            typedef typename std::vector<value_type>::size_type size_type;
+
+        /*
+         * @ValueVector: storage for the values of an interval
+         * @POOL_MAX: maximum number of idle storages kept in the pool
+         */
+        private:
+            typedef std::vector<value_type> ValueVector;
+            enum { POOL_MAX = 4 };
+
+            /*
+             * A pool of storages, shared between IntervalStats and its
+             * Intervals so that Intervals may outlive it
+             */
+            struct Pool {
+                LOCK lock;
+                std::vector<std::unique_ptr<ValueVector>> idle;
+
+                /*
+                 * @return: an empty storage, recycled if possible
+                 */
+                std::unique_ptr<ValueVector> acquire()
+                {
+                    std::unique_ptr<ValueVector> values;
+                    std::lock_guard<LOCK> guard(lock);
+                    if (idle.empty()) {
+                        values.reset(new ValueVector);
+                    } else {
+                        values = std::move(idle.back());
+                        idle.pop_back();
+                    }
+                    return values;
+                }
+
+                /*
+                 * give a storage back, keeping its capacity
+                 *
+                 * @values: storage to recycle
+                 *
+                 * @return: None
+                 */
+                void release(std::unique_ptr<ValueVector> values)
+                {
+                    values->clear();
+                    std::lock_guard<LOCK> guard(lock);
+                    if (idle.size() < POOL_MAX) idle.push_back(std::move(values));
+                }
+            };
+
+        public:
+            /*
+             * The values of a finished interval
+             * It owns its storage, so that it can be queried off the hot path
+             * without copying: percentiles are selected in place, which
+             * reorders the values.
+             * The storage goes back to the pool on destruction.
+             */
+            class Interval {
+                /*
+                 * @values: the interval values, in insertion order until a
+                 *          percentile is computed
+                 * @pool: the pool to give the storage back to
+                 * @since: timestamp of the beginning of the interval
+                 * @until: timestamp of the end of the interval
+                 */
+                private:
+                    std::unique_ptr<ValueVector> values;
+                    std::shared_ptr<Pool> pool;
+                    timestamp_type since_;
+                    timestamp_type until_;
+
+                public:
+                    typedef typename ValueVector::const_iterator const_iterator;
+
+                    Interval(std::unique_ptr<ValueVector> values, std::shared_ptr<Pool> pool,
+                            timestamp_type since, timestamp_type until)
+                        : values(std::move(values)), pool(std::move(pool)), since_(since), until_(until)
+                    {
+                    }
+
+                    Interval(Interval&& other) = default;
+                    Interval& operator= (Interval&& other) = default;
+
+                    ~Interval()
+                    {
+                        if (values) pool->release(std::move(values));
+                    }
+
+                    timestamp_type since() const { return since_; }
+                    timestamp_type until() const { return until_; }
+                    size_type size() const { return values->size(); }
+                    bool empty() const { return values->empty(); }
+                    const_iterator begin() const { return values->begin(); }
+                    const_iterator end() const { return values->end(); }
+
+                    /*
+                     * get the percentile of the interval values
+                     *
+                     * @p: percentile in % (ie 50 means median)
+                     *
+                     * @return: percentile
+                     * @throw: std::out_of_range when the interval is empty or
+                     *         @p is not in [0, 100]
+                     * @complexity: O(N) on average, no copy
+                     */
+                    value_type get_p(int p)
+                    {
+                        if (p < 0 || p > 100) throw std::out_of_range("percentile must be in [0, 100]");
+                        return nth_(p, 1, select::strategy(p, 1));
+                    }
+
+                    /*
+                     * get the percentile P of the interval values, the
+                     * algorithm being chosen at compile time
+                     *
+                     * @P: percentile in %, either an integer or a std::ratio<>
+                     *
+                     * @return: percentile
+                     * @throw: std::out_of_range when the interval is empty
+                     * @complexity: O(N) on average, no copy
+                     */
+                    template <int P>
+                    value_type get_p()
+                    {
+                        return get_p<std::ratio<P>>();
+                    }
+
+                    template <typename P>
+                    value_type get_p()
+                    {
+                        static_assert(P::num >= 0 && P::num <= 100 * P::den, "percentile must be in [0, 100]");
+                        return nth_(P::num, P::den, select::strategy(P::num, P::den));
+                    }
+
+                    /*
+                     * get the 70-percentile of the interval values
+                     *
+                     * @return: 70-percentile
+                     * @throw: std::out_of_range when the interval is empty
+                     * @complexity: O(N) on average, no copy
+                     */
+                    value_type get_p70()
+                    {
+                        return get_p<70>();
+                    }
+
+                private:
+                    /*
+                     * select the percentile num/den in place
+                     * min and max are simple scans, anything else is a
+                     * quickselect on the owned values
+                     *
+                     * @num, @den: percentile in % as a rational
+                     * @strategy: see select::strategy()
+                     *
+                     * @return: percentile
+                     */
+                    value_type nth_(std::intmax_t num, std::intmax_t den, select::Strategy strategy)
+                    {
+                        if (values->empty()) throw std::out_of_range("Interval object is empty");
+                        if (select::MIN == strategy) return *std::min_element(values->begin(), values->end());
+                        if (select::MAX == strategy) return *std::max_element(values->begin(), values->end());
+                        size_type k = select::index(values->size(), num, den);
+                        std::nth_element(values->begin(), values->begin() + k, values->end());
+                        return (*values)[k];
+                    }
+            };
+
+        /*
+         * @pool: idle storages
+         * @lock: protects @active and @since
+         * @active: storage of the current interval
+         * @since: timestamp of the beginning of the current interval
+         */
+        private:
+            std::shared_ptr<Pool> pool;
+            LOCK lock;
+            std::unique_ptr<ValueVector> active;
+            timestamp_type since;
+
+        public:
+            IntervalStats()
+                : pool(std::make_shared<Pool>()), active(pool->acquire()), since(GETTIMESTAMP()())
+            {
+            }
+
+            IntervalStats(const IntervalStats&) = delete;
+            IntervalStats& operator= (const IntervalStats&) = delete;
+
+            /*
+             * add a new value to the current interval
+             *
+             * @val: value
+             *
+             * @return: IntervalStats
+             * @complexity: O(1) (amortized)
+             */
+            IntervalStats& add(value_type val)
+            {
+                std::lock_guard<LOCK> guard(lock);
+                active->push_back(val);
+                return *this;
+            }
+
+            /*
+             * add a batch of values to the current interval, taking the lock
+             * only once
+             *
+             * @first, @last: range of values
+             *
+             * @return: IntervalStats
+             * @complexity: O(last - first) (amortized)
+             */
+            template <typename InputIt>
+            IntervalStats& add(InputIt first, InputIt last)
+            {
+                std::lock_guard<LOCK> guard(lock);
+                active->insert(active->end(), first, last);
+                return *this;
+            }
+
+            /*
+             * end the current interval and start a new one
+             * The fresh storage is taken from the pool before taking the
+             * lock, so that only the swap is done under the lock
+             *
+             * @return: the values of the ended interval
+             * @complexity: O(1)
+             */
+            Interval get_and_reset()
+            {
+                std::unique_ptr<ValueVector> values = pool->acquire();
+                timestamp_type now = GETTIMESTAMP()();
+                timestamp_type start;
+                {
+                    std::lock_guard<LOCK> guard(lock);
+                    std::swap(values, active);
+                    start = since;
+                    since = now;
+                }
+                return Interval(std::move(values), pool, start, now);
+            }
+    };
+
+    /*
+     * IntervalStats supporting concurrent add() and get_and_reset()
+     */
+    template <typename T=double, typename GETTIMESTAMP=GetTimestamp>
+    using ConcurrentIntervalStats = IntervalStats<T, std::mutex, GETTIMESTAMP>;
+
+}
+
+#endif  /* FR_BENOU_INTERVAL_STATS_H_ */
@@ -0,0 +1,196 @@
+#include <cmath>
+#include <stdexcept>
+#include "Stats.hpp"
+
+#ifndef FR_BENOU_MEAN_INDEX_H_
+#define FR_BENOU_MEAN_INDEX_H_
+
+namespace fr_benou {
+
+    /*
+     * Stats index maintaining the count and the sum of the values of each
+     * bucket, for moving averages without going through the values:
+     *     Stats<double, 60, GetTimestamp, MeanIndex<double, 60>> stats;
+     *     double mean = stats.mean_over(10);  // last 10 seconds
+     *
+     * It also maintains load-average-style exponentially weighted moving
+     * averages over 1, 5 and 15 minutes, updated once per second when a
+     * bucket is sealed: they do not depend on TIMEOUT. Values added to a
+     * bucket after it was sealed are not taken into account by them.
+     *
+     * Template parameters:
+     * @T: the value type, convertible to double
+     * @TIMEOUT: the Stats timeout, in seconds
+     * @TS: the timestamp type
+     */
+    template <typename T, int TIMEOUT=60, typename TS=GetTimestamp::timestamp_type>
+    class MeanIndex {
+        /*
+         * @Bucket: count and sum of the values of a timestamp
+         * @Ewma: moving averages of the values count per second and of
+         *        their sum per second
+         */
+        private:
+            struct Bucket {
+                TS ts;
+                unsigned long count;
+                double sum;
+            };
+
+            struct Ewma {
+                double count;
+                double sum;
+            };
+
+            enum { M1, M5, M15, EWMA_MAX };
+
+            Bucket buckets[TIMEOUT];
+            Ewma ewmas[EWMA_MAX];
+            TS newest;
+            TS sealed;
+
+            static double period_(int i)
+            {
+                static const double periods[EWMA_MAX] = {60, 300, 900};
+                return periods[i];
+            }
+
+            /*
+             * update the moving averages with the values of a second
+             *
+             * @count, @sum: count and sum of the values of the second
+             * @seconds: number of seconds elapsed since the previous update,
+             *           the seconds in between having no values
+             *
+             * @return: None
+             */
+            void update_(unsigned long count, double sum, TS seconds)
+            {
+                for (int i=0; i<EWMA_MAX; ++i) {
+                    double decay = std::exp(-1.0 / period_(i));
+                    if (seconds > 1) {
+                        double idle = std::exp(-double(seconds - 1) / period_(i));
+                        ewmas[i].count *= idle;
+                        ewmas[i].sum *= idle;
+                    }
+                    ewmas[i].count = ewmas[i].count * decay + count * (1 - decay);
+                    ewmas[i].sum = ewmas[i].sum * decay + sum * (1 - decay);
+                }
+            }
+
+            /*
+             * @return: mean per second of a moving average
+             */
+            double mean_(int i) const
+            {
+                if (0 == ewmas[i].count) throw std::out_of_range("MeanIndex is empty");
+                return ewmas[i].sum / ewmas[i].count;
+            }
+
+        public:
+            MeanIndex()
+            {
+                clear();
+            }
+
+            void insert(TS ts, const T& val)
+            {
+                Bucket& bucket = buckets[ts % TIMEOUT];
+                if (bucket.ts != ts || 0 == bucket.count) {
+                    bucket.ts = ts;
+                    bucket.count = 0;
+                    bucket.sum = 0;
+                }
+                ++bucket.count;
+                bucket.sum += double(val);
+                if (ts > newest) newest = ts;
+            }
+
+            template <typename It>
+            void seal(TS ts, It, It)
+            {
+                const Bucket& bucket = buckets[ts % TIMEOUT];
+                if (bucket.ts != ts || ts <= sealed) return;
+                update_(bucket.count, bucket.sum, sealed ? ts - sealed : 1);
+                sealed = ts;
+            }
+
+            template <typename It>
+            void expire(TS ts, It, It)
+            {
+                Bucket& bucket = buckets[ts % TIMEOUT];
+                if (bucket.ts == ts) {
+                    bucket.count = 0;
+                    bucket.sum = 0;
+                }
+            }
+
+            void clear()
+            {
+                for (int i=0; i<TIMEOUT; ++i) {
+                    buckets[i].ts = 0;
+                    buckets[i].count = 0;
+                    buckets[i].sum = 0;
+                }
+                for (int i=0; i<EWMA_MAX; ++i) {
+                    ewmas[i].count = 0;
+                    ewmas[i].sum = 0;
+                }
+                newest = 0;
+                sealed = 0;
+            }
+
+            /*
+             * get the mean of the values of the last seconds
+             *
+             * @window: number of seconds, up to TIMEOUT, ending with the
+             *          newest timestamp
+             *
+             * @return: mean of the values whose timestamp is greater than
+             *          newest - @window
+             * @throw: std::out_of_range when there are no such values
+             * @complexity: O(@window)
+             */
+            double mean_over(int window) const
+            {
+                if (window > TIMEOUT) window = TIMEOUT;
+                unsigned long count = 0;
+                double sum = 0;
+                for (int i=0; i<window && TS(i)<=newest; ++i) {
+                    const Bucket& bucket = buckets[(newest - i) % TIMEOUT];
+                    if (bucket.ts == newest - i) {
+                        count += bucket.count;
+                        sum += bucket.sum;
+                    }
+                }
+                if (0 == count) throw std::out_of_range("MeanIndex is empty");
+                return sum / count;
+            }
+
+            /*
+             * get the 1, 5 or 15 minutes moving average of the number of
+             * values per second, like the load average
+             *
+             * @return: number of values per second
+             * @complexity: O(1)
+             */
+            double rate1() const { return ewmas[M1].count; }
+            double rate5() const { return ewmas[M5].count; }
+            double rate15() const { return ewmas[M15].count; }
+
+            /*
+             * get the 1, 5 or 15 minutes moving average of the values,
+             * each second weighted by its number of values
+             *
+             * @return: moving average
+             * @throw: std::out_of_range when no second was sealed yet
+             * @complexity: O(1)
+             */
+            double mean1() const { return mean_(M1); }
+            double mean5() const { return mean_(M5); }
+            double mean15() const { return mean_(M15); }
+    };
+
+}
+
+#endif  /* FR_BENOU_MEAN_INDEX_H_ */
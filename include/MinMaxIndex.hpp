@@ -0,0 +1,171 @@
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include "Stats.hpp"
+
+#ifndef FR_BENOU_MIN_MAX_INDEX_H_
+#define FR_BENOU_MIN_MAX_INDEX_H_
+
+namespace fr_benou {
+
+    /*
+     * Extremum of a sliding window, as a monotonic deque of the per-bucket
+     * extrema
+     * An entry (ts, v) is kept only while no entry at least as recent has a
+     * better value: such an entry would expire later and always win. Hence
+     * timestamps increase and values get worse from front to back, there is
+     * at most one entry per bucket, and the window extremum is the front.
+     *
+     * Template parameters:
+     * @T: the value type
+     * @TS: the timestamp type
+     * @BETTER: strict weak ordering, BETTER(a, b) when a is a better
+     *          extremum than b
+     */
+    template <typename T, typename TS, typename BETTER>
+    class MonotonicExtremum {
+        private:
+            typedef std::pair<TS, T> Entry;
+            std::deque<Entry> entries;
+
+        public:
+            /*
+             * take a new value into account
+             * Values are expected to mostly come in timestamp order: late
+             * values are supported, but need a search in the deque
+             *
+             * @ts: timestamp of the value
+             * @val: value
+             *
+             * @return: None
+             * @complexity: O(1) amortized for in-order values,
+             *              O(TIMEOUT) for late values
+             */
+            void insert(TS ts, const T& val)
+            {
+                BETTER better;
+                if (entries.empty() || entries.back().first <= ts) {
+                    if (!entries.empty() && entries.back().first == ts && !better(val, entries.back().second)) {
+                        return;
+                    }
+                    while (!entries.empty() && !better(entries.back().second, val)) {
+                        entries.pop_back();
+                    }
+                    entries.emplace_back(ts, val);
+                    return;
+                }
+
+                /* late value: the entries as recent as it are a suffix, led by the best of them */
+                typename std::deque<Entry>::iterator pos = entries.begin();
+                while (pos->first < ts) ++pos;
+                if (!better(val, pos->second)) return;
+                if (pos->first == ts) pos = entries.erase(pos);
+                typename std::deque<Entry>::iterator first = pos;
+                while (first != entries.begin() && !better(std::prev(first)->second, val)) --first;
+                pos = entries.erase(first, pos);
+                entries.emplace(pos, ts, val);
+            }
+
+            /*
+             * forget the values of timestamps up to @ts
+             *
+             * @ts: expired timestamp
+             *
+             * @return: None
+             * @complexity: O(1) amortized
+             */
+            void expire(TS ts)
+            {
+                while (!entries.empty() && entries.front().first <= ts) {
+                    entries.pop_front();
+                }
+            }
+
+            void clear()
+            {
+                entries.clear();
+            }
+
+            bool empty() const
+            {
+                return entries.empty();
+            }
+
+            /*
+             * @return: the extremum of the values still in the window
+             * @complexity: O(1)
+             */
+            const T& get() const
+            {
+                return entries.front().second;
+            }
+    };
+
+    /*
+     * Stats index maintaining the minimum and maximum of the window, so
+     * that Stats::min() and Stats::max() are O(1) instead of scanning all
+     * the values:
+     *     Stats<double, 60, GetTimestamp, MinMaxIndex<double>> stats;
+     *
+     * Template parameters:
+     * @T: the value type, ordered by operator<
+     * @TS: the timestamp type
+     */
+    template <typename T, typename TS=GetTimestamp::timestamp_type>
+    class MinMaxIndex {
+        private:
+            MonotonicExtremum<T, TS, std::less<T>> mins;
+            MonotonicExtremum<T, TS, std::greater<T>> maxs;
+
+        public:
+            void insert(TS ts, const T& val)
+            {
+                mins.insert(ts, val);
+                maxs.insert(ts, val);
+            }
+
+            template <typename It>
+            void seal(TS, It, It)
+            {
+            }
+
+            template <typename It>
+            void expire(TS ts, It, It)
+            {
+                mins.expire(ts);
+                maxs.expire(ts);
+            }
+
+            void clear()
+            {
+                mins.clear();
+                maxs.clear();
+            }
+
+            /*
+             * @return: minimum of the window
+             * @throw: std::out_of_range when there are no values
+             * @complexity: O(1)
+             */
+            const T& min() const
+            {
+                if (mins.empty()) throw std::out_of_range("MinMaxIndex is empty");
+                return mins.get();
+            }
+
+            /*
+             * @return: maximum of the window
+             * @throw: std::out_of_range when there are no values
+             * @complexity: O(1)
+             */
+            const T& max() const
+            {
+                if (maxs.empty()) throw std::out_of_range("MinMaxIndex is empty");
+                return maxs.get();
+            }
+    };
+
+}
+
+#endif  /* FR_BENOU_MIN_MAX_INDEX_H_ */
@@ -0,0 +1,296 @@
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "Stats.hpp"
+
+#ifndef FR_BENOU_ORDER_STATISTIC_INDEX_H_
+#define FR_BENOU_ORDER_STATISTIC_INDEX_H_
+
+namespace fr_benou {
+
+    /*
+     * Stats index keeping all the values of the window in an order-statistic
+     * tree, so that any percentile is found in O(log N) instead of going
+     * through the values, for workloads querying after nearly every add():
+     *     Stats<double, 60, GetTimestamp, OrderStatisticIndex<double, 60>> stats;
+     *     double p99 = stats.get_p(99);  // O(log N)
+     *
+     * The tree is a treap whose nodes count their subtree size. Nodes live in
+     * a pool and are reused once expired, and the nodes of each second are
+     * chained together so that a whole second is removed when its bucket
+     * expires, whatever values the bucket kept (see Stats::set_budget()).
+     * Each value costs a node (about 24 bytes besides the value) and add()
+     * becomes O(log N).
+     *
+     * Template parameters:
+     * @T: the value type, ordered by operator<
+     * @TIMEOUT: the Stats timeout, in seconds
+     * @TS: the timestamp type
+     */
+    template <typename T, int TIMEOUT=60, typename TS=GetTimestamp::timestamp_type>
+    class OrderStatisticIndex {
+        /*
+         * @size_type: a type large enough to count the values of the window
+         */
+        public:
+            typedef std::uint32_t size_type;
+
+        /*
+         * @Node: a value, its treap priority, its children and subtree size,
+         *        and the next node of the same second (or of the free list)
+         * @Second: the timestamp and first node of a second
+         * @NIL: the null node index. nodes[NIL] is a sentinel of size 0
+         * @nodes: the nodes pool
+         * @free: first unused node of the pool
+         * @root: root of the treap
+         * @seconds: per-second node chains, indexed by timestamp % TIMEOUT
+         * @seed: state of the priorities pseudo-random generator
+         */
+        private:
+            struct Node {
+                T value;
+                std::uint32_t priority;
+                size_type left;
+                size_type right;
+                size_type size;
+                size_type next;
+            };
+
+            struct Second {
+                TS ts;
+                size_type head;
+            };
+
+            enum { NIL = 0 };
+
+            std::vector<Node> nodes;
+            size_type free;
+            size_type root;
+            Second seconds[TIMEOUT];
+            std::uint32_t seed;
+
+            /*
+             * @return: true if node @a is before node @b in the tree. Equal
+             *          values are ordered by node index, so that each node
+             *          has a unique position
+             */
+            bool less_(size_type a, size_type b) const
+            {
+                if (nodes[a].value < nodes[b].value) return true;
+                if (nodes[b].value < nodes[a].value) return false;
+                return a < b;
+            }
+
+            void update_(size_type n)
+            {
+                nodes[n].size = 1 + nodes[nodes[n].left].size + nodes[nodes[n].right].size;
+            }
+
+            /*
+             * split the subtree @t into the nodes before @n and the others
+             *
+             * @t: subtree root
+             * @n: node, not in @t
+             * @lo, @hi: the resulting subtrees
+             *
+             * @return: None
+             * @complexity: O(log N) expected
+             */
+            void split_(size_type t, size_type n, size_type& lo, size_type& hi)
+            {
+                if (NIL == t) {
+                    lo = hi = NIL;
+                } else if (less_(t, n)) {
+                    split_(nodes[t].right, n, nodes[t].right, hi);
+                    update_(t);
+                    lo = t;
+                } else {
+                    split_(nodes[t].left, n, lo, nodes[t].left);
+                    update_(t);
+                    hi = t;
+                }
+            }
+
+            /*
+             * merge two subtrees, all the nodes of @lo being before the ones
+             * of @hi
+             *
+             * @return: the merged subtree root
+             * @complexity: O(log N) expected
+             */
+            size_type merge_(size_type lo, size_type hi)
+            {
+                if (NIL == lo) return hi;
+                if (NIL == hi) return lo;
+                if (nodes[lo].priority > nodes[hi].priority) {
+                    nodes[lo].right = merge_(nodes[lo].right, hi);
+                    update_(lo);
+                    return lo;
+                }
+                nodes[hi].left = merge_(lo, nodes[hi].left);
+                update_(hi);
+                return hi;
+            }
+
+            /*
+             * @return: the subtree @t with node @n inserted
+             * @complexity: O(log N) expected
+             */
+            size_type insert_(size_type t, size_type n)
+            {
+                if (NIL == t) return n;
+                if (nodes[n].priority > nodes[t].priority) {
+                    split_(t, n, nodes[n].left, nodes[n].right);
+                    update_(n);
+                    return n;
+                }
+                if (less_(n, t)) {
+                    nodes[t].left = insert_(nodes[t].left, n);
+                } else {
+                    nodes[t].right = insert_(nodes[t].right, n);
+                }
+                update_(t);
+                return t;
+            }
+
+            /*
+             * @return: the subtree @t with node @n removed
+             * @complexity: O(log N) expected
+             */
+            size_type erase_(size_type t, size_type n)
+            {
+                if (t == n) return merge_(nodes[t].left, nodes[t].right);
+                if (less_(n, t)) {
+                    nodes[t].left = erase_(nodes[t].left, n);
+                } else {
+                    nodes[t].right = erase_(nodes[t].right, n);
+                }
+                update_(t);
+                return t;
+            }
+
+            /*
+             * remove all the nodes of a second, giving them back to the pool
+             *
+             * @second: second to empty
+             *
+             * @return: None
+             * @complexity: O(k*log(N)), k being the number of values of
+             *              @second
+             */
+            void drop_(Second& second)
+            {
+                size_type n = second.head;
+                while (NIL != n) {
+                    size_type next = nodes[n].next;
+                    root = erase_(root, n);
+                    nodes[n].next = free;
+                    free = n;
+                    n = next;
+                }
+                second.head = NIL;
+            }
+
+            /*
+             * @return: a node from the pool, growing it if needed
+             */
+            size_type alloc_()
+            {
+                if (NIL == free) {
+                    nodes.push_back(Node());
+                    return size_type(nodes.size() - 1);
+                }
+                size_type n = free;
+                free = nodes[n].next;
+                return n;
+            }
+
+        public:
+            OrderStatisticIndex()
+            {
+                clear();
+            }
+
+            void insert(TS ts, const T& val)
+            {
+                Second& second = seconds[ts % TIMEOUT];
+                if (second.ts != ts) {
+                    drop_(second);
+                    second.ts = ts;
+                }
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                size_type n = alloc_();
+                nodes[n].value = val;
+                nodes[n].priority = seed;
+                nodes[n].left = NIL;
+                nodes[n].right = NIL;
+                nodes[n].size = 1;
+                nodes[n].next = second.head;
+                second.head = n;
+                root = insert_(root, n);
+            }
+
+            template <typename It>
+            void seal(TS, It, It) {}
+
+            template <typename It>
+            void expire(TS ts, It, It)
+            {
+                /* after a long gap, the slot may hold an older second */
+                Second& second = seconds[ts % TIMEOUT];
+                if (second.ts <= ts) drop_(second);
+            }
+
+            void clear()
+            {
+                nodes.assign(1, Node());
+                nodes[NIL].size = 0;
+                free = NIL;
+                root = NIL;
+                for (int i=0; i<TIMEOUT; ++i) {
+                    seconds[i].ts = 0;
+                    seconds[i].head = NIL;
+                }
+                seed = 2463534242u;
+            }
+
+            /*
+             * @return: number of values in the window
+             */
+            size_type size() const
+            {
+                return nodes[root].size;
+            }
+
+            /*
+             * get the k-th smallest value of the window
+             *
+             * @k: 0-based rank
+             *
+             * @return: value
+             * @throw: std::out_of_range when @k is not less than size()
+             * @complexity: O(log N) expected
+             */
+            T select(size_type k) const
+            {
+                if (k >= size()) throw std::out_of_range("OrderStatisticIndex rank out of range");
+                size_type t = root;
+                for (;;) {
+                    size_type left = nodes[nodes[t].left].size;
+                    if (k < left) {
+                        t = nodes[t].left;
+                    } else if (k == left) {
+                        return nodes[t].value;
+                    } else {
+                        k -= left + 1;
+                        t = nodes[t].right;
+                    }
+                }
+            }
+    };
+
+}
+
+#endif  /* FR_BENOU_ORDER_STATISTIC_INDEX_H_ */
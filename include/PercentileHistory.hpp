@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#include "Stats.hpp"
+
+#ifndef FR_BENOU_PERCENTILE_HISTORY_H_
+#define FR_BENOU_PERCENTILE_HISTORY_H_
+
+namespace fr_benou {
+
+    /*
+     * Stats index keeping the history of some percentiles, per second
+     * The percentiles of each bucket are computed once, when the bucket is
+     * sealed (ie when a newer second starts), and stored in a ring of
+     * HISTORY points, independent of the Stats TIMEOUT:
+     *     Stats<double, 60, GetTimestamp, PercentileHistory<double, 3600, 50, 70, 99>> stats;
+     *     std::vector<decltype(stats)::index_type::Point> points(60);
+     *     points.resize(stats.index().last(points.data(), points.size()));
+     *
+     * Seconds without values have no point, the newest second has none
+     * until it is sealed, and values added to a second after it was sealed
+     * are not taken into account.
+     *
+     * Template parameters:
+     * @T: the value type, trivially copyable and ordered by operator<
+     * @HISTORY: number of points kept
+     * @P: the percentiles in %, preferably in increasing order
+     */
+    template <typename T, int HISTORY, int... P>
+    class PercentileHistory {
+        static_assert(sizeof...(P) > 0, "at least one percentile is needed");
+        static_assert(std::is_trivially_copyable<T>::value, "points are copied with memcpy");
+
+        /*
+         * @Point: the percentiles of a second, in the order of P
+         * @PERCENTILES: number of percentiles per point
+         */
+        public:
+            enum { PERCENTILES = sizeof...(P) };
+            typedef GetTimestamp::timestamp_type timestamp_type;
+            struct Point {
+                timestamp_type ts;
+                std::array<T, PERCENTILES> p;
+            };
+
+        /*
+         * @points: the ring of points, allocated on first use
+         * @head: index of the next point to write
+         * @count: number of valid points
+         * @scratch: copy of the sealed bucket values, reused across seals
+         */
+        private:
+            std::vector<Point> points;
+            int head;
+            int count;
+            std::vector<T> scratch;
+
+        public:
+            PercentileHistory() : head(0), count(0)
+            {
+            }
+
+            /*
+             * copies do not need the scratch buffer
+             */
+            PercentileHistory(const PercentileHistory& other)
+                : points(other.points), head(other.head), count(other.count)
+            {
+            }
+
+            PercentileHistory& operator= (const PercentileHistory& other)
+            {
+                points = other.points;
+                head = other.head;
+                count = other.count;
+                return *this;
+            }
+
+            template <typename TS>
+            void insert(TS, const T&) {}
+
+            /*
+             * compute and store the percentiles of a sealed bucket
+             * Percentiles are selected in increasing order, each selection
+             * only going through the elements above the previous one
+             *
+             * @complexity: O(bucket size) on average
+             */
+            template <typename TS, typename It>
+            void seal(TS ts, It first, It last)
+            {
+                if (first == last) return;
+                scratch.assign(first, last);
+                if (points.empty()) points.resize(HISTORY);
+                Point& point = points[head];
+                point.ts = ts;
+                static const int percentiles[PERCENTILES] = {P...};
+                typename std::vector<T>::iterator lo = scratch.begin();
+                for (int i=0; i<PERCENTILES; ++i) {
+                    typename std::vector<T>::iterator nth =
+                        scratch.begin() + select::index(scratch.size(), percentiles[i], 1);
+                    if (nth < lo) lo = scratch.begin();
+                    std::nth_element(lo, nth, scratch.end());
+                    point.p[i] = *nth;
+                    lo = nth;
+                }
+                head = (head + 1) % HISTORY;
+                if (count < HISTORY) ++count;
+            }
+
+            template <typename TS, typename It>
+            void expire(TS, It, It) {}
+
+            void clear()
+            {
+                head = 0;
+                count = 0;
+            }
+
+            /*
+             * @return: number of points in the history
+             */
+            int size() const
+            {
+                return count;
+            }
+
+            /*
+             * copy the newest points of the history, oldest first
+             *
+             * @out: destination, room for @n points
+             * @n: maximum number of points to copy
+             *
+             * @return: number of points copied
+             * @complexity: O(n), at most two memcpy
+             */
+            std::size_t last(Point *out, std::size_t n) const
+            {
+                if (n > std::size_t(count)) n = count;
+                std::size_t start = (head + HISTORY - n) % HISTORY;
+                std::size_t first = std::min(n, std::size_t(HISTORY) - start);
+                if (first) std::memcpy(out, &points[start], first * sizeof(Point));
+                if (n > first) std::memcpy(out + first, &points[0], (n - first) * sizeof(Point));
+                return n;
+            }
+    };
+
+}
+
+#endif  /* FR_BENOU_PERCENTILE_HISTORY_H_ */
@@ -0,0 +1,190 @@
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "StatsSelect.hpp"
+
+#ifndef FR_BENOU_QUANTILE_SKETCH_H_
+#define FR_BENOU_QUANTILE_SKETCH_H_
+
+namespace fr_benou {
+
+    /*
+     * QuantileSketch: approximate percentiles with a bounded relative error
+     * Values are counted in logarithmic bins: a value x falls in the bin i
+     * such that gamma^(i-1) < |x| <= gamma^i, with
+     * gamma = (1 + alpha) / (1 - alpha), and is estimated by the bin
+     * representative 2 * gamma^i / (gamma + 1), which is within alpha * |x|
+     * of x. Percentiles are thus within alpha relative error, and the size
+     * of the sketch only depends on the range of the values, not on their
+     * number: about log(max / min) / (2 * alpha) bins.
+     * Values whose magnitude is below MIN_VALUE are counted as 0.
+     * Sketches with the same alpha can be merged.
+     */
+    class QuantileSketch {
+        /*
+         * @count_type: a type large enough to count all the values
+         * @Bin: a bin representative and its number of values
+         */
+        public:
+            typedef std::uint64_t count_type;
+            typedef std::pair<double, count_type> Bin;
+
+        /*
+         * A dense array of bin counts, starting at bin @offset
+         */
+        private:
+            struct Store {
+                int offset;
+                std::vector<std::uint32_t> counts;
+
+                Store() : offset(0) {}
+
+                void add(int i, std::uint32_t count)
+                {
+                    if (counts.empty()) {
+                        offset = i;
+                    } else if (i < offset) {
+                        counts.insert(counts.begin(), offset - i, 0);
+                        offset = i;
+                    }
+                    if (i - offset >= int(counts.size())) counts.resize(i - offset + 1, 0);
+                    counts[i - offset] += count;
+                }
+            };
+
+            static constexpr double MIN_VALUE = 1e-9;
+
+            double alpha_;
+            double gamma;
+            double log_gamma;
+            Store positive;
+            Store negative;
+            count_type zero;
+            count_type count;
+
+            int key_(double x) const
+            {
+                return int(std::ceil(std::log(x) / log_gamma));
+            }
+
+            double representative_(int i) const
+            {
+                return 2 * std::pow(gamma, i) / (gamma + 1);
+            }
+
+        public:
+            /*
+             * @alpha: relative accuracy, in ]0, 1[
+             */
+            explicit QuantileSketch(double alpha = 0.01)
+                : alpha_(alpha), gamma((1 + alpha) / (1 - alpha)), log_gamma(std::log(gamma)),
+                zero(0), count(0)
+            {
+                if (!(alpha > 0 && alpha < 1)) throw std::invalid_argument("alpha must be in ]0, 1[");
+            }
+
+            double alpha() const { return alpha_; }
+            count_type size() const { return count; }
+            bool empty() const { return 0 == count; }
+
+            /*
+             * count a value
+             *
+             * @x: value
+             *
+             * @return: QuantileSketch
+             * @complexity: O(1) (amortized) when the bin range does not grow
+             */
+            QuantileSketch& add(double x)
+            {
+                if (x > MIN_VALUE) {
+                    positive.add(key_(x), 1);
+                } else if (x < -MIN_VALUE) {
+                    negative.add(key_(-x), 1);
+                } else {
+                    ++zero;
+                }
+                ++count;
+                return *this;
+            }
+
+            /*
+             * add the values of another sketch
+             *
+             * @other: sketch with the same alpha
+             *
+             * @return: QuantileSketch
+             * @throw: std::invalid_argument when alpha differs
+             * @complexity: O(bins of @other)
+             */
+            QuantileSketch& merge(const QuantileSketch& other)
+            {
+                if (other.alpha_ != alpha_) throw std::invalid_argument("cannot merge sketches with different alpha");
+                for (std::size_t i=0; i<other.positive.counts.size(); ++i) {
+                    if (other.positive.counts[i]) positive.add(other.positive.offset + i, other.positive.counts[i]);
+                }
+                for (std::size_t i=0; i<other.negative.counts.size(); ++i) {
+                    if (other.negative.counts[i]) negative.add(other.negative.offset + i, other.negative.counts[i]);
+                }
+                zero += other.zero;
+                count += other.count;
+                return *this;
+            }
+
+            void clear()
+            {
+                positive = Store();
+                negative = Store();
+                zero = 0;
+                count = 0;
+            }
+
+            /*
+             * get the non-empty bins in increasing values order
+             *
+             * @return: bins representatives and counts
+             * @complexity: O(bins)
+             */
+            std::vector<Bin> bins() const
+            {
+                std::vector<Bin> result;
+                for (std::size_t i=negative.counts.size(); i-- > 0;) {
+                    if (negative.counts[i]) result.emplace_back(-representative_(negative.offset + i), negative.counts[i]);
+                }
+                if (zero) result.emplace_back(0.0, zero);
+                for (std::size_t i=0; i<positive.counts.size(); ++i) {
+                    if (positive.counts[i]) result.emplace_back(representative_(positive.offset + i), positive.counts[i]);
+                }
+                return result;
+            }
+
+            /*
+             * get an estimation of a percentile of the values
+             *
+             * @p: percentile in % (ie 50 means median)
+             *
+             * @return: percentile, within alpha relative error
+             * @throw: std::out_of_range when the sketch is empty or @p is
+             *         not in [0, 100]
+             * @complexity: O(bins)
+             */
+            double get_p(int p) const
+            {
+                if (p < 0 || p > 100) throw std::out_of_range("percentile must be in [0, 100]");
+                if (0 == count) throw std::out_of_range("QuantileSketch is empty");
+                count_type k = select::index(count, p, 1);
+                count_type rank = 0;
+                std::vector<Bin> all = bins();
+                for (const Bin& bin : all) {
+                    rank += bin.second;
+                    if (rank > k) return bin.first;
+                }
+                return all.back().first;
+            }
+    };
+
+}
+
+#endif  /* FR_BENOU_QUANTILE_SKETCH_H_ */
@@ -1,10 +1,17 @@
 #include <iterator>
 #include <algorithm>
+#include <memory>
 #include <stdexcept>
+#include <type_traits>
 #include <utility>
 #include <vector>
+#include <cstddef>
 #include <cstdint>
 #include <ctime>
+#include <ratio>
+#include "StatsSelect.hpp"
+#include "StatsIndex.hpp"
+#include "StatsStorage.hpp"
 
 #ifndef FR_BENOU_STATS_H_
 #define FR_BENOU_STATS_H_
@@ -32,29 +39,579 @@ namespace fr_benou {
      * @T: the value type
      * @TIMEOUT: max lifetime for values
      * @GETTIMESTAMP: Callable functor returning the current timestamp when called
+     * @INDEX: an index maintained along the values, see StatsIndex.hpp
+     * @STORAGE: the buckets memory layout, see StatsStorage.hpp
      *
      */
-    template <typename T=double, int TIMEOUT=60, typename GETTIMESTAMP=GetTimestamp> class Stats {
+    template <typename T=double, int TIMEOUT=60, typename GETTIMESTAMP=GetTimestamp,
+             typename INDEX=NoIndex, typename STORAGE=PairStorage> class Stats {
         /*
          * @timestamp_type: timestamp values type
          * @value_type: stored values type
          * @StatsPair: a std::pair<> containing (timestamp, value)
          * @size_type: a type large enough to count all stored elements
+         * @index_type: the index type
+         * @storage_type: the storage type
          */
         public:
             typedef typename GETTIMESTAMP::timestamp_type timestamp_type;
             typedef T value_type;
             typedef std::pair<timestamp_type, value_type> StatsPair;
             typedef typename std::vector<StatsPair>::size_type size_type;
+            typedef INDEX index_type;
+            typedef STORAGE storage_type;
 
         /*
          * @StatsVector: a bucket for single timestamp
+         * @BucketPtr: a shared bucket. Buckets are copy-on-write, so that
+         *             copies of Stats can share them (see Stats(const Stats&))
+         *             A null BucketPtr is an empty bucket
          * @statsBuckets: per-timestamp bucket
+         * @epoch: incremented each time buckets may have been replaced,
+         *         shared or expired, so that Writers know they have to look
+         *         their bucket up again
+         * @newest: newest timestamp added. Buckets older than
+         *          newest - TIMEOUT are expired as soon as it moves forward
+         * @index: the index maintained along the buckets
+         * @budget: maximum number of values stored per bucket, 0 for no
+         *          limit. See set_budget()
+         * @seen: per-bucket number of values added, when it is more than
+         *        the number of values stored. 0 if the bucket is not sampled
+         * @seed: state of the sampling pseudo-random generator
+         * @occupied: bitmap of the buckets that may hold values, so that
+         *            iterators jump over empty buckets
+         * @count: number of values stored
          */
         private:
-            typedef std::vector<StatsPair> StatsVector;
+            typedef typename STORAGE::template Bucket<timestamp_type, value_type> StatsVector;
+            typedef std::shared_ptr<StatsVector> BucketPtr;
 
-            StatsVector statsBuckets[TIMEOUT];
+            BucketPtr statsBuckets[TIMEOUT];
+            mutable unsigned long epoch;
+            timestamp_type newest;
+            INDEX index_;
+            size_type budget;
+            size_type seen[TIMEOUT];
+            std::uint64_t seed;
+            enum { WORD_BITS = 64, WORDS = (TIMEOUT + WORD_BITS - 1) / WORD_BITS };
+            std::uint64_t occupied[WORDS];
+            size_type count;
+
+            /*
+             * @return: the index of the lowest (highest) bit set in @bits,
+             *          which must not be 0
+             */
+            static int lowest_bit_(std::uint64_t bits)
+            {
+#if defined(__GNUC__)
+                return __builtin_ctzll(bits);
+#else
+                int i = 0;
+                for (; !(bits & 1); bits >>= 1) ++i;
+                return i;
+#endif
+            }
+
+            static int highest_bit_(std::uint64_t bits)
+            {
+#if defined(__GNUC__)
+                return WORD_BITS - 1 - __builtin_clzll(bits);
+#else
+                int i = WORD_BITS - 1;
+                for (; !(bits >> (WORD_BITS - 1)); bits <<= 1) --i;
+                return i;
+#endif
+            }
+
+            /*
+             * hint the CPU that the values of a bucket will be read soon
+             *
+             * @index: bucket index
+             *
+             * @return: None
+             */
+            void prefetch_(int index) const
+            {
+#if defined(__GNUC__)
+                const BucketPtr& bucket = statsBuckets[index];
+                if (bucket && !bucket->empty()) __builtin_prefetch(bucket->data());
+#else
+                (void)index;
+#endif
+            }
+
+            /*
+             * find the next bucket that may hold values, going circularly
+             * from @from (excluded) to @stop (included), 64 buckets at a time
+             *
+             * @from: current bucket index
+             * @stop: last bucket index to consider, not @from
+             *
+             * @return: the index of the next occupied bucket, @stop if there
+             *          is none
+             * @complexity: O(TIMEOUT / 64)
+             */
+            int next_occupied_(int from, int stop) const
+            {
+                int remaining = (stop - from + TIMEOUT) % TIMEOUT;
+                int i = from + 1;
+                while (remaining > 0) {
+                    if (TIMEOUT == i) i = 0;
+                    int span = std::min(std::min<int>(WORD_BITS - i % WORD_BITS, TIMEOUT - i), remaining);
+                    std::uint64_t bits = occupied[i / WORD_BITS] >> (i % WORD_BITS);
+                    if (span < WORD_BITS) bits &= (std::uint64_t(1) << span) - 1;
+                    if (bits) return i + lowest_bit_(bits);
+                    i += span;
+                    remaining -= span;
+                }
+                return stop;
+            }
+
+            /*
+             * find the previous bucket that may hold values, going
+             * circularly from @from (excluded) to @stop (included) backward
+             *
+             * @from: current bucket index
+             * @stop: last bucket index to consider, not @from
+             *
+             * @return: the index of the previous occupied bucket, @stop if
+             *          there is none
+             * @complexity: O(TIMEOUT / 64)
+             */
+            int prev_occupied_(int from, int stop) const
+            {
+                int remaining = (from - stop + TIMEOUT) % TIMEOUT;
+                int i = from - 1;
+                while (remaining > 0) {
+                    if (i < 0) i = TIMEOUT - 1;
+                    int span = std::min(i % WORD_BITS + 1, remaining);
+                    std::uint64_t bits = occupied[i / WORD_BITS] << (WORD_BITS - 1 - i % WORD_BITS);
+                    if (span < WORD_BITS) bits &= ~((std::uint64_t(1) << (WORD_BITS - span)) - 1);
+                    if (bits) return i - (WORD_BITS - 1 - highest_bit_(bits));
+                    i -= span;
+                    remaining -= span;
+                }
+                return stop;
+            }
+
+            /*
+             * mark a bucket as (possibly) holding values, or as empty
+             *
+             * @index: bucket index
+             *
+             * @return: None
+             */
+            void occupy_(int index)
+            {
+                occupied[index / WORD_BITS] |= std::uint64_t(1) << (index % WORD_BITS);
+            }
+
+            void release_(int index)
+            {
+                occupied[index / WORD_BITS] &= ~(std::uint64_t(1) << (index % WORD_BITS));
+            }
+
+            /*
+             * get a bucket for reading
+             *
+             * @index: bucket index
+             *
+             * @return: the bucket, or an empty one if it was never allocated
+             */
+            const StatsVector& bucket_at_(int index) const
+            {
+                static const StatsVector empty;
+                return statsBuckets[index] ? *statsBuckets[index] : empty;
+            }
+
+            /*
+             * projection extracting the value of a StatsPair, for selection
+             * algorithms
+             */
+            struct pairValue_ {
+                const value_type& operator() (const StatsPair& sp) const { return sp.second; }
+            };
+
+            /*
+             * projection applying a user projection on the value of a
+             * StatsPair, for selection algorithms
+             */
+            template <typename Proj>
+            struct pairProjection_ {
+                Proj proj;
+                auto operator() (const StatsPair& sp) const
+                    -> decltype(select::project(std::declval<const Proj&>(), sp.second))
+                {
+                    return select::project(proj, sp.second);
+                }
+            };
+
+            /*
+             * @return: true if some buckets of the window were sampled
+             */
+            bool sampled_() const
+            {
+                for (int i=0; i<TIMEOUT; ++i) {
+                    if (seen[i]) return true;
+                }
+                return false;
+            }
+
+            /*
+             * count the values stored in the window, and the values added
+             * to it before sampling
+             *
+             * @stored: number of values stored
+             * @offered: number of values added
+             *
+             * @return: None
+             */
+            void weights_(size_type& stored, size_type& offered) const
+            {
+                for (int i=0; i<TIMEOUT; ++i) {
+                    size_type n = bucket_at_(i).size();
+                    stored += n;
+                    offered += seen[i] ? seen[i] : n;
+                }
+            }
+
+            /*
+             * select a percentile when some buckets were sampled: each
+             * stored value stands for seen / stored values of its bucket
+             *
+             * @num, @den: percentile in % as a rational
+             * @proj: projection of a StatsPair to the value to rank
+             *
+             * @return: percentile
+             * @complexity: O(N*log(N)), N being bounded by TIMEOUT * budget
+             */
+            template <typename Proj>
+            typename select::projected<Proj, typename StatsVector::const_iterator>::type
+            weighted_(std::intmax_t num, std::intmax_t den, Proj proj) const
+            {
+                typedef typename select::projected<Proj, typename StatsVector::const_iterator>::type projected_type;
+                typedef std::pair<projected_type, double> Weighted;
+                std::vector<Weighted> values;
+                size_type offered = 0;
+                for (int i=0; i<TIMEOUT; ++i) {
+                    const StatsVector& bucket = bucket_at_(i);
+                    if (bucket.empty()) continue;
+                    size_type n = seen[i] ? seen[i] : bucket.size();
+                    double weight = double(n) / bucket.size();
+                    offered += n;
+                    for (auto it = bucket.begin(); it != bucket.end(); ++it) {
+                        values.emplace_back(proj(*it), weight);
+                    }
+                }
+                std::sort(values.begin(), values.end(),
+                        [](const Weighted& a, const Weighted& b) { return a.first < b.first; });
+                double k = double(select::index(offered, num, den));
+                double rank = 0;
+                for (const Weighted& v : values) {
+                    rank += v.second;
+                    if (rank > k + 1e-9) return v.first;
+                }
+                return values.back().first;
+            }
+
+            /*
+             * window extrema, from the index when it maintains them (see
+             * MinMaxIndex), by scanning the values otherwise
+             */
+            template <typename I>
+            auto min_(const I& index, int) const -> decltype(index.min(), value_type())
+            {
+                return index.min();
+            }
+
+            value_type min_(const INDEX&, long) const
+            {
+                size_type sz = size();
+                if (0 == sz) throw std::out_of_range("Stats object is empty");
+                return select::min(begin(), end(), pairValue_());
+            }
+
+            template <typename I>
+            auto max_(const I& index, int) const -> decltype(index.max(), value_type())
+            {
+                return index.max();
+            }
+
+            value_type max_(const INDEX&, long) const
+            {
+                size_type sz = size();
+                if (0 == sz) throw std::out_of_range("Stats object is empty");
+                return select::max(begin(), end(), pairValue_());
+            }
+
+            /*
+             * percentile, from the index when it maintains the order of the
+             * values (see OrderStatisticIndex) or this very percentile (see
+             * TwoHeapIndex), by selecting it among the values otherwise
+             */
+            template <typename I>
+            auto percentile_(const I& index, std::intmax_t num, std::intmax_t den, int) const
+                -> decltype(index.select(index.size()), value_type())
+            {
+                return index.select(select::index(index.size(), num, den));
+            }
+
+            template <typename I>
+            auto percentile_(const I& index, std::intmax_t num, std::intmax_t den, int) const
+                -> decltype(index.percentile(), typename I::percentile_type(), value_type())
+            {
+                typedef typename I::percentile_type maintained;
+                if (num * maintained::den == den * maintained::num) return index.percentile();
+                return percentile_(index_, num, den, 0L);
+            }
+
+            value_type percentile_(const INDEX&, std::intmax_t num, std::intmax_t den, long) const
+            {
+                if (sampled_()) return weighted_(num, den, pairValue_());
+                return select::percentile(begin(), end(), size(), num, den, pairValue_());
+            }
+
+            template <typename P, typename I>
+            auto percentile_(const I& index, int) const
+                -> decltype(index.select(index.size()), value_type())
+            {
+                return index.select(select::index(index.size(), P::num, P::den));
+            }
+
+            template <typename P, typename I>
+            auto percentile_(const I& index, int) const
+                -> typename std::enable_if<std::ratio_equal<P, typename I::percentile_type>::value,
+                        decltype(index.percentile(), value_type())>::type
+            {
+                return index.percentile();
+            }
+
+            template <typename P>
+            value_type percentile_(const INDEX&, long) const
+            {
+                if (sampled_()) return weighted_(P::num, P::den, pairValue_());
+                return select::percentile<P>(begin(), end(), size(), pairValue_());
+            }
+
+            /*
+             * moving average, from the index when it maintains the buckets
+             * sums (see MeanIndex), by going through the values otherwise
+             */
+            template <typename I>
+            auto mean_over_(const I& index, int window, int) const -> decltype(index.mean_over(window))
+            {
+                return index.mean_over(window);
+            }
+
+            double mean_over_(const INDEX&, int window, long) const
+            {
+                size_type count = 0;
+                double sum = 0;
+                for (auto it = rbegin(); it != rend() && it->first + window > newest; ++it) {
+                    sum += double(it->second);
+                    ++count;
+                }
+                if (0 == count) throw std::out_of_range("Stats object is empty");
+                return sum / count;
+            }
+
+            /*
+             * is_iterator_<It>::value is true when It can be dereferenced
+             * and incremented, so that the batch add() overloads do not
+             * hijack add(timestamp, value) calls
+             */
+            template <typename It, typename = void>
+            struct is_iterator_ : std::false_type {};
+
+            template <typename It>
+            struct is_iterator_<It, decltype((void)*std::declval<It&>(), (void)++std::declval<It&>())>
+                : std::true_type {};
+
+            /*
+             * get the bucket for a timestamp, moving the window forward if
+             * @ts is the newest timestamp
+             *
+             * @ts: timestamp
+             *
+             * @return: the bucket where to store values for @ts, or NULL if
+             *          @ts is too old to be in the window
+             */
+            StatsVector* bucket_(timestamp_type ts)
+            {
+                if (ts > newest) {
+                    advance_(ts);
+                } else if (ts + TIMEOUT <= newest) {
+                    return NULL;
+                }
+                BucketPtr& bucket = statsBuckets[ts % TIMEOUT];
+                occupy_(ts % TIMEOUT);
+                if (!bucket) {
+                    bucket = std::make_shared<StatsVector>();
+                } else if (bucket.use_count() != 1) {
+                    /* shared with a copy: copy on write */
+                    bucket = std::make_shared<StatsVector>(*bucket);
+                    ++epoch;
+                }
+                return bucket.get();
+            }
+
+            /*
+             * move the window forward: seal the newest bucket, then expire
+             * the buckets older than @ts - TIMEOUT in timestamp order
+             *
+             * @ts: the new newest timestamp
+             *
+             * @return: None
+             * @complexity: O(min(ts - newest, TIMEOUT))
+             */
+            void advance_(timestamp_type ts)
+            {
+                const BucketPtr& sealed = statsBuckets[newest % TIMEOUT];
+                if (sealed && !sealed->empty() && sealed->ts() == newest) {
+                    index_.seal(newest, sealed->values_begin(), sealed->values_end());
+                }
+                if (ts >= TIMEOUT) {
+                    timestamp_type last = ts - TIMEOUT;
+                    timestamp_type first = newest >= TIMEOUT ? newest - TIMEOUT + 1 : 0;
+                    if (last - first >= TIMEOUT) first = last - TIMEOUT + 1;
+                    for (timestamp_type t = first; t <= last; ++t) {
+                        BucketPtr& bucket = statsBuckets[t % TIMEOUT];
+                        if (bucket && !bucket->empty()) {
+                            index_.expire(t, bucket->values_begin(), bucket->values_end());
+                            count -= bucket->size();
+                            recycle_(bucket);
+                            seen[t % TIMEOUT] = 0;
+                        }
+                        release_(t % TIMEOUT);
+                    }
+                }
+                newest = ts;
+                ++epoch;
+            }
+
+            /*
+             * reservoir sampling of a full bucket: the n-th value of the
+             * bucket is kept with probability budget / n, replacing a
+             * random one
+             *
+             * @ts: timestamp of the bucket
+             *
+             * @return: the index of the value to replace, budget or more to
+             *          drop the new value
+             * @complexity: O(1)
+             */
+            size_type sample_(timestamp_type ts)
+            {
+                size_type& n = seen[ts % TIMEOUT];
+                if (0 == n) n = budget;
+                ++n;
+                seed ^= seed >> 12;
+                seed ^= seed << 25;
+                seed ^= seed >> 27;
+                /* uniform in [0, n) without a division, n being far below 2^32 */
+                return size_type(((seed * 2685821657736338717ULL) >> 32) * n >> 32);
+            }
+
+            /*
+             * keep a bucket within the budget once a value was constructed
+             * at its end
+             *
+             * @bucket: a bucket holding budget + 1 values, the last one
+             *          being the new one
+             *
+             * @return: None
+             * @complexity: O(1)
+             */
+            void shed_(StatsVector& bucket)
+            {
+                size_type r = sample_(bucket.ts());
+                bucket.evict(r < budget ? r : budget);
+                --count;
+            }
+
+            /*
+             * account for a value just constructed at the end of a bucket:
+             * notify the index, and keep the bucket within the budget
+             *
+             * @bucket: bucket the value was added to
+             *
+             * @return: None
+             * @complexity: O(1)
+             */
+            void stored_(StatsVector& bucket)
+            {
+                index_.insert(bucket.ts(), bucket.back_value());
+                ++count;
+                if (budget && bucket.size() > budget) shed_(bucket);
+            }
+
+            /*
+             * empty a bucket, keeping its storage when it is not shared
+             *
+             * @bucket: bucket to empty
+             *
+             * @return: None
+             */
+            void recycle_(BucketPtr& bucket)
+            {
+                if (bucket.use_count() == 1) {
+                    bucket->clear();
+                } else {
+                    bucket.reset();
+                    ++epoch;
+                }
+            }
+
+            /*
+             * share the buckets of another Stats object, copying its newest
+             * bucket
+             *
+             * @other: Stats object to share buckets with
+             *
+             * @return: None
+             */
+            void share_(const Stats& other)
+            {
+                for (int i=0; i<TIMEOUT; ++i) {
+                    statsBuckets[i] = other.statsBuckets[i];
+                }
+                newest = other.newest;
+                index_ = other.index_;
+                budget = other.budget;
+                std::copy(other.seen, other.seen + TIMEOUT, seen);
+                std::copy(other.occupied, other.occupied + WORDS, occupied);
+                seed = other.seed;
+                count = other.count;
+                BucketPtr& bucket = statsBuckets[newest % TIMEOUT];
+                if (bucket) bucket = std::make_shared<StatsVector>(*bucket);
+                ++other.epoch;
+                ++epoch;
+            }
+
+            /*
+             * make room for a batch of values in a bucket
+             * Only done when the batch size is known upfront (forward
+             * iterators). The capacity still grows geometrically so that
+             * repeated small batches remain O(1) amortized
+             *
+             * @bucket: bucket to grow
+             * @first, @last: range of values to be added
+             *
+             * @return: None
+             */
+            template <typename It>
+            static void reserve_(StatsVector& bucket, It first, It last, std::forward_iterator_tag)
+            {
+                size_type needed = bucket.size() + std::distance(first, last);
+                if (needed > bucket.capacity()) {
+                    bucket.reserve(std::max(needed, 2 * bucket.capacity()));
+                }
+            }
+
+            template <typename It>
+            static void reserve_(StatsVector&, It, It, std::input_iterator_tag)
+            {
+            }
 
             /*
              * A compound iterator for Stats
@@ -65,111 +622,219 @@ namespace fr_benou {
              * A completely compliant InputIterator would need more care though.
              */
             struct statsBucketsIterator
-                : public std::iterator<std::input_iterator_tag, typename StatsVector::value_type> {
+                : public std::iterator<std::input_iterator_tag, typename StatsVector::value_type, std::ptrdiff_t,
+                    const typename StatsVector::value_type*,
+                    typename std::iterator_traits<typename StatsVector::const_iterator>::reference> {
                     /*
                      * @sv_iterator: the inner bucket vector iterator type
                      * @value_type: elements value type
+                     * @reference: elements reference type, a value when
+                     *             the storage rebuilds the elements
                      */
                     typedef typename StatsVector::const_iterator sv_iterator;
-                    typedef typename sv_iterator::value_type value_type;
+                    typedef typename std::iterator_traits<sv_iterator>::value_type value_type;
+                    typedef typename std::iterator_traits<sv_iterator>::reference reference;
 
                     /*
                      * @current: the current inner bucket vector iterator
                      * @stats: the Stats object we iterate on
-                     * @ts_min: minimum timestamp to consider. As the buckets recycling occurs
-                     *          only on inserts (see Stats.add() below), some old elements may
-                     *          linger from some time. We must ignore them when iterating.
                      * @index: the current bucket index
                      * @index_max: the last bucket index, were we have to stop iterating
+                     *
+                     * Buckets are recycled as soon as the window moves past them (see
+                     * bucket_()), so that all the values are valid
                      */
                     sv_iterator current;
                     const Stats *stats;
-                    timestamp_type ts_min;
                     int index;
                     int index_max;
 
                     /*
-                     * On intialization, we need to determine the min and max
-                     * timestamps, in order to know where to start and end
+                     * The iteration ends with the bucket of the newest
+                     * timestamp, and starts right after it
                      *
                      * @stats: Stats object to iterate on
                      */
                     statsBucketsIterator(const Stats *stats)
-                        : stats(stats), index(0), index_max(0)
+                        : stats(stats), index(0), index_max(stats->newest % TIMEOUT)
                     {
-                        timestamp_type max = 0;
-                        for (int i=0; i<TIMEOUT; ++i) {
-                            if (!stats->statsBuckets[i].empty()
-                                    && stats->statsBuckets[i][0].first > max) {
-                                max = stats->statsBuckets[i][0].first;
-                                index_max = i;
-                            }
+                    }
+
+                    /*
+                     * utility functions for circular increment for
+                     * buckets index
+                     *
+                     * @index: current bucket index
+                     *
+                     * @return: next buckets
+                     */
+                    int next_(int index)
+                    {
+                        return (index + 1) % TIMEOUT;
+                    }
+
+                    /*
+                     * utility function to jump from the end of a vector
+                     * to the begining of the next non-empty one
+                     * Empty buckets are skipped through the occupancy
+                     * bitmap, and the values of the bucket after the new
+                     * one are prefetched while the new one is read
+                     *
+                     * @return: None
+                     */
+                    void seek()
+                    {
+                        while (current == stats->bucket_at_(index).end() && index != index_max) {
+                            index = stats->next_occupied_(index, index_max);
+                            current = stats->bucket_at_(index).begin();
+                            if (index != index_max) stats->prefetch_(stats->next_occupied_(index, index_max));
                         }
-                        ts_min = max - TIMEOUT;
                     }
 
                     /*
-                     * utility functions for circular increment for
-                     * buckets index
+                     * initialize the iterator from 1st (older) element
+                     *
+                     * @return: a const iterator starting from older element
+                     */
+                    const statsBucketsIterator& begin()
+                    {
+                        index = next_(index_max);
+                        current = stats->bucket_at_(index).begin();
+                        seek();
+                        return *this;
+                    }
+
+                    /*
+                     * initialize the iterator past the last (newest) element
+                     *
+                     * @return: a const iterator past the newest element
+                     */
+                    const statsBucketsIterator& end()
+                    {
+                        index = index_max;
+                        current = stats->bucket_at_(index).end();
+                        return *this;
+                    }
+
+                    const statsBucketsIterator& operator++ ()
+                    {
+                        ++current;
+                        seek();
+                        return *this;
+                    }
+
+                    reference operator* () const
+                    {
+                        return *current;
+                    }
+
+                    const sv_iterator operator-> () const
+                    {
+                        return current;
+                    }
+
+                    bool operator!= (const statsBucketsIterator& other) const {
+                        return this->current != other.current;
+                    }
+
+            };
+
+            /*
+             * A reverse compound iterator for Stats
+             * It goes from newest to older elements, in reverse insertion
+             * order, so that looking at the latest elements does not require
+             * going through the whole Stats.
+             * Like statsBucketsIterator, it is a simple InputIterator.
+             */
+            struct statsBucketsReverseIterator
+                : public std::iterator<std::input_iterator_tag, typename StatsVector::value_type, std::ptrdiff_t,
+                    const typename StatsVector::value_type*,
+                    typename std::iterator_traits<typename StatsVector::const_reverse_iterator>::reference> {
+                    /*
+                     * @sv_iterator: the inner bucket vector reverse iterator type
+                     * @value_type: elements value type
+                     * @reference: elements reference type, see
+                     *             statsBucketsIterator
+                     */
+                    typedef typename StatsVector::const_reverse_iterator sv_iterator;
+                    typedef typename std::iterator_traits<sv_iterator>::value_type value_type;
+                    typedef typename std::iterator_traits<sv_iterator>::reference reference;
+
+                    /*
+                     * @current: the current inner bucket vector iterator
+                     * @stats: the Stats object we iterate on
+                     * @index: the current bucket index
+                     * @index_max: the newest bucket index, were we start iterating
+                     * @index_min: the oldest bucket index, were we have to stop iterating
+                     */
+                    sv_iterator current;
+                    const Stats *stats;
+                    int index;
+                    int index_max;
+                    int index_min;
+
+                    /*
+                     * The window is determined the same way as for
+                     * statsBucketsIterator
                      *
-                     * @index: current bucket index
-                     *
-                     * @return: next buckets
+                     * @stats: Stats object to iterate on
                      */
-                    int next_(int index)
+                    statsBucketsReverseIterator(const Stats *stats)
+                        : stats(stats), index(0)
                     {
-                        return (index + 1) % TIMEOUT;
+                        index_max = stats->newest % TIMEOUT;
+                        index_min = (index_max + 1) % TIMEOUT;
                     }
 
                     /*
-                     * utility function to jump from the end of a vector
-                     * to the begining of the next one
+                     * utility function to jump from the beginning of a vector
+                     * to the end of the previous non-empty one, see
+                     * statsBucketsIterator::seek()
                      *
                      * @return: None
                      */
                     void seek()
                     {
-                        while ((current == stats->statsBuckets[index].end()
-                                    || current->first < ts_min)
-                                && index != index_max) {
-                            index = next_(index);
-                            current = stats->statsBuckets[index].begin();
+                        while (current == stats->bucket_at_(index).rend() && index != index_min) {
+                            index = stats->prev_occupied_(index, index_min);
+                            current = stats->bucket_at_(index).rbegin();
+                            if (index != index_min) stats->prefetch_(stats->prev_occupied_(index, index_min));
                         }
                     }
 
                     /*
-                     * initialize the iterator from 1st (older) element
+                     * initialize the iterator from the newest element
                      *
-                     * @return: a const iterator starting from older element
+                     * @return: a const iterator starting from newest element
                      */
-                    const statsBucketsIterator& begin()
+                    const statsBucketsReverseIterator& begin()
                     {
-                        index = next_(index_max);
-                        current = stats->statsBuckets[index].begin();
+                        index = index_max;
+                        current = stats->bucket_at_(index).rbegin();
                         seek();
                         return *this;
                     }
 
                     /*
-                     * initialize the iterator past the last (newest) element
+                     * initialize the iterator past the oldest element
                      *
-                     * @return: a const iterator past the newest element
+                     * @return: a const iterator past the oldest element
                      */
-                    const statsBucketsIterator& end()
+                    const statsBucketsReverseIterator& end()
                     {
-                        index = index_max;
-                        current = stats->statsBuckets[index].end();
+                        index = index_min;
+                        current = stats->bucket_at_(index).rend();
                         return *this;
                     }
 
-                    const statsBucketsIterator& operator++ ()
+                    const statsBucketsReverseIterator& operator++ ()
                     {
                         ++current;
                         seek();
                         return *this;
                     }
 
-                    const value_type& operator* () const
+                    reference operator* () const
                     {
                         return *current;
                     }
@@ -179,13 +844,57 @@ namespace fr_benou {
                         return current;
                     }
 
-                    bool operator!= (const statsBucketsIterator& other) const {
+                    bool operator!= (const statsBucketsReverseIterator& other) const {
                         return this->current != other.current;
                     }
 
             };
 
         public:
+            /*
+             * @index: initial index, for indexes needing parameters
+             */
+            explicit Stats(const INDEX& index = INDEX())
+                : epoch(0), newest(0), index_(index), budget(0), seen(), seed(0x9e3779b97f4a7c15ULL),
+                occupied(), count(0)
+            {
+            }
+
+            /*
+             * copy a Stats object
+             * Buckets are shared with @other and copied only when one of
+             * the copies writes to them. The newest bucket is copied
+             * upfront, as it is the one being written to: copying a Stats
+             * costs O(newest bucket) instead of O(N), and the writers of
+             * @other are not slowed down.
+             * The copy must be synchronized with writers of @other like any
+             * other read, but it can then be used without synchronization.
+             *
+             * @other: Stats object to copy
+             */
+            Stats(const Stats& other) : epoch(0), newest(0), count(0)
+            {
+                share_(other);
+            }
+
+            Stats& operator= (const Stats& other)
+            {
+                if (this != &other) share_(other);
+                return *this;
+            }
+
+            /*
+             * get a snapshot of the Stats elements, sharing older buckets
+             * with this object. See Stats(const Stats&)
+             *
+             * @return: a Stats object holding the same elements
+             * @complexity: O(newest bucket)
+             */
+            Stats snapshot() const
+            {
+                return Stats(*this);
+            }
+
             /*
              * @const_iterator: Stats elements const iterator
              */
@@ -212,17 +921,76 @@ namespace fr_benou {
             }
 
             /*
-             * return the number of elements in Stats
+             * @const_reverse_iterator: Stats elements const reverse iterator
+             */
+            typedef statsBucketsReverseIterator const_reverse_iterator;
+
+            /*
+             * get a reverse iterator on the newest Stats element
+             *
+             * @return: const reverse iterator on the newest Stats element
+             */
+            const_reverse_iterator rbegin() const
+            {
+                return statsBucketsReverseIterator(this).begin();
+            }
+
+            /*
+             * get a reverse iterator past the oldest Stats element
+             *
+             * @return: const reverse iterator past the oldest Stats element
+             */
+            const_reverse_iterator rend() const
+            {
+                return statsBucketsReverseIterator(this).end();
+            }
+
+            /*
+             * get the @n newest valid Stats elements
+             * Iteration starts from the newest element and stops as soon as
+             * @n elements are found
+             *
+             * @n: maximum number of elements to return
+             *
+             * @return: the @n newest elements, in timestamp order, preserving
+             *          insertion order
+             * @complexity: O(n)
+             */
+            std::vector<StatsPair> last(size_type n) const
+            {
+                std::vector<StatsPair> res;
+                for (auto it = rbegin(), end = rend(); res.size() < n && it != end; ++it) {
+                    res.push_back(*it);
+                }
+                std::reverse(res.begin(), res.end());
+                return res;
+            }
+
+            /*
+             * return the number of valid elements in Stats
              *
              * @return: the number of elements in Stats
+             * @complexity: O(1)
              */
             size_type size() const
             {
-                size_type sz = 0;
+                return count;
+            }
+
+            /*
+             * get the memory used by the buckets, including the ones shared
+             * with copies
+             *
+             * @return: number of bytes
+             * @complexity: O(TIMEOUT)
+             */
+            std::size_t memory() const
+            {
+                std::size_t bytes = 0;
                 for (int i=0; i<TIMEOUT; ++i) {
-                    sz += statsBuckets[i].size();
+                    if (statsBuckets[i]) bytes += statsBuckets[i]->memory();
                 }
-                return sz;
+                return bytes;
             }
 
             /*
@@ -233,12 +1001,60 @@ namespace fr_benou {
             void clear()
             {
                 for (int i=0; i<TIMEOUT; ++i) {
-                    statsBuckets[i].clear();
+                    if (statsBuckets[i]) recycle_(statsBuckets[i]);
+                    seen[i] = 0;
                 }
+                std::fill(occupied, occupied + WORDS, 0);
+                count = 0;
+                newest = 0;
+                index_.clear();
+            }
+
+            /*
+             * limit the number of values stored per second
+             * Once a second got @budget values, the following ones are
+             * sampled: each bucket keeps a uniform sample of @budget values
+             * and records how many values it was offered, so that
+             * percentiles weight each bucket by its sampling rate. Memory
+             * and query costs are then bounded whatever the load.
+             * Indexes still see every value.
+             *
+             * @budget: maximum number of values per second, 0 for no limit
+             *
+             * @return: None
+             */
+            void set_budget(size_type budget)
+            {
+                this->budget = budget;
+            }
+
+            /*
+             * get the fraction of the values of the window that are stored
+             *
+             * @return: sampling rate, in ]0, 1], 1 when nothing was sampled
+             * @complexity: O(TIMEOUT)
+             */
+            double sampling_rate() const
+            {
+                size_type stored = 0, offered = 0;
+                weights_(stored, offered);
+                return offered ? double(stored) / offered : 1;
+            }
+
+            /*
+             * get the index maintained along the values
+             *
+             * @return: the index
+             */
+            const INDEX& index() const
+            {
+                return index_;
             }
 
             /*
              * add a new (timestamp, value) pair
+             * Values older than the newest timestamp - TIMEOUT are out of
+             * the window and are dropped
              *
              * @statsPair: std::pair<>(timestamp, value)
              *
@@ -247,11 +1063,17 @@ namespace fr_benou {
              */
             Stats& add(StatsPair statsPair)
             {
-                timestamp_type ts = statsPair.first;
-                int index = ts % TIMEOUT;
-                StatsVector& bucket = statsBuckets[index];
-                if (!bucket.empty() && ts != bucket[0].first) bucket.clear();
-                bucket.push_back(statsPair);
+                StatsVector *bucket = bucket_(statsPair.first);
+                if (bucket) {
+                    index_.insert(statsPair.first, statsPair.second);
+                    if (budget && bucket->size() >= budget) {
+                        size_type r = sample_(statsPair.first);
+                        if (r < budget) bucket->replace(r, statsPair.second);
+                    } else {
+                        bucket->emplace(statsPair.first, statsPair.second);
+                        ++count;
+                    }
+                }
                 return *this;
             }
 
@@ -283,6 +1105,227 @@ namespace fr_benou {
                 return add(GETTIMESTAMP()(), val);
             }
 
+            /*
+             * construct a new value in place with the given timestamp
+             *
+             * @ts: timestamp
+             * @args: arguments forwarded to the value_type constructor
+             *
+             * @return: Stats
+             * @complexity: O(1) (amortized)
+             */
+            template <typename... Args>
+            Stats& emplace_at(timestamp_type ts, Args&&... args)
+            {
+                StatsVector *bucket = bucket_(ts);
+                if (bucket) {
+                    bucket->emplace(ts, std::forward<Args>(args)...);
+                    stored_(*bucket);
+                }
+                return *this;
+            }
+
+            /*
+             * construct a new value in place, automatically timestamping it
+             * with current timestamp
+             *
+             * @args: arguments forwarded to the value_type constructor
+             *
+             * @return: Stats
+             * @complexity: O(1) (amortized)
+             */
+            template <typename... Args>
+            Stats& emplace(Args&&... args)
+            {
+                return emplace_at(GETTIMESTAMP()(), std::forward<Args>(args)...);
+            }
+
+            /*
+             * add a batch of values sharing the same timestamp
+             * The bucket is looked up once and, for forward iterators, its
+             * storage is reserved once for the whole batch
+             *
+             * @ts: timestamp
+             * @first, @last: range of values
+             *
+             * @return: Stats
+             * @complexity: O(last - first) (amortized)
+             */
+            template <typename InputIt>
+            typename std::enable_if<is_iterator_<InputIt>::value, Stats&>::type
+            add(timestamp_type ts, InputIt first, InputIt last)
+            {
+                StatsVector *bucket = bucket_(ts);
+                if (bucket) {
+                    if (!budget) reserve_(*bucket, first, last,
+                            typename std::iterator_traits<InputIt>::iterator_category());
+                    for (; first != last; ++first) {
+                        bucket->emplace(ts, *first);
+                        stored_(*bucket);
+                    }
+                }
+                return *this;
+            }
+
+            /*
+             * add a batch of values, automatically timestamping them with
+             * current timestamp. The clock is read only once for the batch
+             *
+             * @first, @last: range of values
+             *
+             * @return: Stats
+             * @complexity: O(last - first) (amortized)
+             */
+            template <typename InputIt>
+            typename std::enable_if<is_iterator_<InputIt>::value, Stats&>::type
+            add(InputIt first, InputIt last)
+            {
+                return add(GETTIMESTAMP()(), first, last);
+            }
+
+            /*
+             * add all values of a container (or any range supporting
+             * std::begin() and std::end()), automatically timestamping them
+             * with current timestamp
+             *
+             * @values: range of values
+             *
+             * @return: Stats
+             * @complexity: O(values.size()) (amortized)
+             */
+            template <typename Range>
+            auto add(const Range& values)
+                -> decltype(std::begin(values), std::end(values), std::declval<Stats&>())
+            {
+                return add(std::begin(values), std::end(values));
+            }
+
+            /*
+             * A lightweight handle for tight insertion loops
+             * It caches the current bucket and its timestamp, so that add()
+             * only reads the clock on the fast path: the bucket is looked up
+             * again only when the timestamp changes.
+             * A Writer must not outlive its Stats.
+             */
+            class Writer {
+                /*
+                 * @stats: the Stats object we write to
+                 * @ts: timestamp of the cached bucket
+                 * @bucket: the cached bucket, NULL if @ts is out of the window
+                 * @epoch: Stats epoch when the bucket was looked up
+                 */
+                private:
+                    Stats *stats;
+                    timestamp_type ts;
+                    StatsVector *bucket;
+                    unsigned long epoch;
+
+                public:
+                    /*
+                     * @stats: Stats object to write to
+                     */
+                    explicit Writer(Stats& stats)
+                        : stats(&stats), ts(GETTIMESTAMP()()), bucket(stats.bucket_(ts)),
+                        epoch(stats.epoch)
+                    {
+                    }
+
+                    /*
+                     * add a new value, automatically timestamping it with
+                     * current timestamp
+                     *
+                     * @val: value
+                     *
+                     * @return: Writer
+                     * @complexity: O(1) (amortized)
+                     */
+                    Writer& add(value_type val)
+                    {
+                        if (resolve_(GETTIMESTAMP()())) {
+                            stats->index_.insert(ts, val);
+                            if (stats->budget && bucket->size() >= stats->budget) {
+                                size_type r = stats->sample_(ts);
+                                if (r < stats->budget) bucket->replace(r, val);
+                            } else {
+                                bucket->emplace(ts, val);
+                                ++stats->count;
+                            }
+                        }
+                        return *this;
+                    }
+
+                    /*
+                     * construct a new value in place, automatically
+                     * timestamping it with current timestamp
+                     *
+                     * @args: arguments forwarded to the value_type constructor
+                     *
+                     * @return: Writer
+                     * @complexity: O(1) (amortized)
+                     */
+                    template <typename... Args>
+                    Writer& emplace(Args&&... args)
+                    {
+                        if (resolve_(GETTIMESTAMP()())) {
+                            bucket->emplace(ts, std::forward<Args>(args)...);
+                            stats->stored_(*bucket);
+                        }
+                        return *this;
+                    }
+
+                    /*
+                     * add a batch of values, automatically timestamping them
+                     * with current timestamp
+                     *
+                     * @first, @last: range of values
+                     *
+                     * @return: Writer
+                     * @complexity: O(last - first) (amortized)
+                     */
+                    template <typename InputIt>
+                    Writer& add(InputIt first, InputIt last)
+                    {
+                        if (resolve_(GETTIMESTAMP()())) {
+                            if (!stats->budget) reserve_(*bucket, first, last,
+                                    typename std::iterator_traits<InputIt>::iterator_category());
+                            for (; first != last; ++first) {
+                                bucket->emplace(ts, *first);
+                                stats->stored_(*bucket);
+                            }
+                        }
+                        return *this;
+                    }
+
+                private:
+                    /*
+                     * look the bucket up again if the timestamp changed, or
+                     * if the buckets were copied, replaced or expired
+                     *
+                     * @now: current timestamp
+                     *
+                     * @return: true if there is a bucket for @now
+                     */
+                    bool resolve_(timestamp_type now)
+                    {
+                        if (now != ts || epoch != stats->epoch) {
+                            bucket = stats->bucket_(now);
+                            ts = now;
+                            epoch = stats->epoch;
+                        }
+                        return bucket != NULL;
+                    }
+            };
+
+            /*
+             * get a Writer handle on this Stats
+             *
+             * @return: a Writer caching the current bucket
+             */
+            Writer writer()
+            {
+                return Writer(*this);
+            }
+
             /*
              * return a const iterator over all valid Stats elements
              * valid Stats elements are the latest 60s elements
@@ -299,23 +1342,149 @@ namespace fr_benou {
             /*
              * get the percentile of valid Stats elements
              * valid Stats elements are the latest 60s elements
+             * The algorithm is chosen at run time depending on @p, see
+             * select::strategy()
              *
              * @p: percentile in % (ie 50 means median)
              *
              * @return: percentile
-             * @throw: std::out_of_range when Stats is empty
+             * @throw: std::out_of_range when Stats is empty or @p is not in [0, 100]
              * @complexity: O(N+N^2) worst case
              *              O(2*N) average case
+             *              O(log N) with an OrderStatisticIndex
+             *              O(1) with a TwoHeapIndex maintaining @p
              */
             value_type get_p(int p) const
+            {
+                if (p < 0 || p > 100) throw std::out_of_range("percentile must be in [0, 100]");
+                size_type sz = size();
+                if (0 == sz) throw std::out_of_range("Stats object is empty");
+                return percentile_(index_, p, 1, 0);
+            }
+
+            /*
+             * get the percentile P of valid Stats elements
+             * valid Stats elements are the latest 60s elements
+             * The algorithm is chosen at compile time: min or max scan for
+             * 0 and 100, bounded heap for the 1% extremes, quickselect
+             * otherwise
+             *
+             * @P: percentile in %, either an integer or a std::ratio<> (ie
+             *     get_p<std::ratio<999, 10>>() for the 99.9-percentile)
+             *
+             * @return: percentile
+             * @throw: std::out_of_range when Stats is empty
+             * @complexity: O(N) for 0 and 100
+             *              O(N*log(N/100)) worst case for the 1% extremes
+             *              O(2*N) average case otherwise
+             *              O(log N) with an OrderStatisticIndex
+             *              O(1) with a TwoHeapIndex maintaining P
+             */
+            template <int P>
+            value_type get_p() const
+            {
+                return get_p<std::ratio<P>>();
+            }
+
+            template <typename P>
+            value_type get_p() const
+            {
+                size_type sz = size();
+                if (0 == sz) throw std::out_of_range("Stats object is empty");
+                return percentile_<P>(index_, 0);
+            }
+
+            /*
+             * get the percentile of a field (or any projection) of valid
+             * Stats elements, for instance when the value type is a record:
+             *     stats.get_p(99, &Request::latency);
+             * Only the projected field takes part in the selection
+             *
+             * @p: percentile in % (ie 50 means median)
+             * @proj: a callable taking a value_type, or a pointer to data member
+             *
+             * @return: percentile of the projected values
+             * @throw: std::out_of_range when Stats is empty or @p is not in [0, 100]
+             * @complexity: same as get_p(p)
+             */
+            template <typename Proj>
+            typename select::projected<pairProjection_<Proj>, const_iterator>::type
+            get_p(int p, Proj proj) const
+            {
+                if (p < 0 || p > 100) throw std::out_of_range("percentile must be in [0, 100]");
+                size_type sz = size();
+                if (0 == sz) throw std::out_of_range("Stats object is empty");
+                if (sampled_()) return weighted_(p, 1, pairProjection_<Proj>{proj});
+                return select::percentile(begin(), end(), sz, p, 1, pairProjection_<Proj>{proj});
+            }
+
+            /*
+             * get the percentile P of a field (or any projection) of valid
+             * Stats elements, the algorithm being chosen at compile time
+             *
+             * @P: percentile in %, either an integer or a std::ratio<>
+             * @proj: a callable taking a value_type, or a pointer to data member
+             *
+             * @return: percentile of the projected values
+             * @throw: std::out_of_range when Stats is empty
+             * @complexity: same as get_p<P>()
+             */
+            template <int P, typename Proj>
+            typename select::projected<pairProjection_<Proj>, const_iterator>::type
+            get_p(Proj proj) const
+            {
+                return get_p<std::ratio<P>>(proj);
+            }
+
+            template <typename P, typename Proj>
+            typename select::projected<pairProjection_<Proj>, const_iterator>::type
+            get_p(Proj proj) const
             {
                 size_type sz = size();
-                if (0 == sz) throw std::out_of_range("Stats object is empty"); 
-                std::vector<T> v(sz);
-                std::transform(begin(), end(), v.begin(), [](const StatsPair& sp){return sp.second;});
-                size_type index = (sz * p + 99) / 100;
-                std::nth_element(v.begin(), v.begin() + index, v.end());
-                return v[index];
+                if (0 == sz) throw std::out_of_range("Stats object is empty");
+                if (sampled_()) return weighted_(P::num, P::den, pairProjection_<Proj>{proj});
+                return select::percentile<P>(begin(), end(), sz, pairProjection_<Proj>{proj});
+            }
+
+            /*
+             * get the minimum of valid Stats elements
+             *
+             * @return: minimum
+             * @throw: std::out_of_range when Stats is empty
+             * @complexity: O(1) with a MinMaxIndex, O(N) otherwise
+             */
+            value_type min() const
+            {
+                return min_(index_, 0);
+            }
+
+            /*
+             * get the maximum of valid Stats elements
+             *
+             * @return: maximum
+             * @throw: std::out_of_range when Stats is empty
+             * @complexity: O(1) with a MinMaxIndex, O(N) otherwise
+             */
+            value_type max() const
+            {
+                return max_(index_, 0);
+            }
+
+            /*
+             * get the mean of the values of the last seconds
+             *
+             * @window: number of seconds, up to TIMEOUT, ending with the
+             *          newest timestamp
+             *
+             * @return: mean of the values whose timestamp is greater than
+             *          newest - @window
+             * @throw: std::out_of_range when there are no such values
+             * @complexity: O(@window) with a MeanIndex, O(values in @window)
+             *              otherwise
+             */
+            double mean_over(int window) const
+            {
+                return mean_over_(index_, window, 0);
             }
 
             /*
@@ -326,10 +1495,11 @@ namespace fr_benou {
              * @throw: std::out_of_range when Stats is empty
              * @complexity: O(N+N^2) worst case
              *              O(2*N) average case
+             *              O(1) with a TwoHeapIndex maintaining it
              */
             value_type get_p70() const
             {
-                return get_p(70);
+                return get_p<70>();
             }
     };
 
@@ -0,0 +1,80 @@
+#ifndef FR_BENOU_STATS_INDEX_H_
+#define FR_BENOU_STATS_INDEX_H_
+
+namespace fr_benou {
+
+    /*
+     * Stats indexes
+     * An index is an optional structure maintained by Stats alongside its
+     * buckets (see the INDEX template parameter of Stats), to answer some
+     * queries without going through all the values.
+     * Stats notifies its index of the following events:
+     *
+     * @insert(ts, val): @val was stored in the bucket of timestamp @ts
+     * @seal(ts, first, last): the bucket of timestamp @ts is no longer the
+     *                         newest one, [@first, @last) being its values.
+     *                         Late values may still be inserted in it
+     * @expire(ts, first, last): the bucket of timestamp @ts left the
+     *                           window, [@first, @last) being its values.
+     *                           Buckets expire in timestamp order
+     * @clear(): all values were removed
+     *
+     * All the events must be implemented, even if they do nothing. Indexes
+     * are copied along with Stats.
+     */
+
+    /*
+     * The default index: maintains nothing
+     */
+    struct NoIndex {
+        template <typename TS, typename V>
+        void insert(TS, const V&) {}
+
+        template <typename TS, typename It>
+        void seal(TS, It, It) {}
+
+        template <typename TS, typename It>
+        void expire(TS, It, It) {}
+
+        void clear() {}
+    };
+
+    /*
+     * Several indexes maintained together, for instance:
+     *     Stats<double, 60, GetTimestamp, IndexSet<MinMaxIndex<double>, MeanIndex<double>>>
+     * The queries of each index are available on the set, as long as no two
+     * indexes provide the same one.
+     */
+    template <typename... Indexes>
+    struct IndexSet : Indexes... {
+        template <typename TS, typename V>
+        void insert(TS ts, const V& val)
+        {
+            int unused[] = {0, (Indexes::insert(ts, val), 0)...};
+            (void)unused;
+        }
+
+        template <typename TS, typename It>
+        void seal(TS ts, It first, It last)
+        {
+            int unused[] = {0, (Indexes::seal(ts, first, last), 0)...};
+            (void)unused;
+        }
+
+        template <typename TS, typename It>
+        void expire(TS ts, It first, It last)
+        {
+            int unused[] = {0, (Indexes::expire(ts, first, last), 0)...};
+            (void)unused;
+        }
+
+        void clear()
+        {
+            int unused[] = {0, (Indexes::clear(), 0)...};
+            (void)unused;
+        }
+    };
+
+}
+
+#endif  /* FR_BENOU_STATS_INDEX_H_ */
@@ -0,0 +1,441 @@
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <ratio>
+#include <type_traits>
+#include <vector>
+#include <cstdint>
+
+#ifndef FR_BENOU_STATS_SELECT_H_
+#define FR_BENOU_STATS_SELECT_H_
+
+namespace fr_benou {
+
+    /*
+     * Selection algorithms used by Stats to compute percentiles
+     * All of them work on a range of (at least) input iterators, going
+     * through the range with a projection extracting the value to rank from
+     * each element.
+     * The range must not be empty.
+     */
+    namespace select {
+
+        /*
+         * @MIN: percentile 0, a single min scan
+         * @MAX: percentile 100, a single max scan
+         * @HEAD: low percentile, a bounded max-heap of the smallest elements
+         * @TAIL: high percentile, a bounded min-heap of the largest elements
+         * @NTH: any other percentile, copy + quickselect
+         */
+        enum Strategy { MIN, MAX, HEAD, TAIL, NTH };
+
+        /*
+         * choose the cheapest algorithm for the percentile num/den
+         * Heaps are used for the 1% extremes, where they hold at most 1% of
+         * the elements and most elements are rejected by a single comparison
+         * with the top of the heap. Beyond that, quickselect is faster.
+         *
+         * @num, @den: percentile in % as a rational
+         *
+         * @return: strategy
+         */
+        constexpr Strategy strategy(std::intmax_t num, std::intmax_t den)
+        {
+            return 0 == num ? MIN
+                : num == 100 * den ? MAX
+                : num <= den ? HEAD
+                : num >= 99 * den ? TAIL
+                : NTH;
+        }
+
+        /*
+         * get the 0-based index of the percentile num/den in @n sorted
+         * elements, clamped to the last element
+         *
+         * @n: number of elements
+         * @num, @den: percentile in % as a rational
+         *
+         * @return: index
+         */
+        template <typename Size>
+        Size index(Size n, std::intmax_t num, std::intmax_t den)
+        {
+            Size index = (n * num + 100 * den - 1) / (100 * den);
+            return index < n ? index : n - 1;
+        }
+
+        /*
+         * apply a projection to a value
+         * The projection is either a callable or a pointer to data member
+         *
+         * @proj: projection
+         * @val: value to project
+         *
+         * @return: projected value
+         */
+        template <typename Proj, typename V>
+        auto project(const Proj& proj, const V& val) -> decltype(proj(val))
+        {
+            return proj(val);
+        }
+
+        template <typename M, typename C, typename V>
+        auto project(M C::* proj, const V& val) -> decltype(val.*proj)
+        {
+            return val.*proj;
+        }
+
+        /*
+         * @Proj: projection type
+         * @It: iterator type
+         * @type: projected value type
+         */
+        template <typename Proj, typename It>
+        struct projected {
+            typedef typename std::decay<
+                decltype(std::declval<Proj&>()(*std::declval<It&>()))>::type type;
+        };
+
+        /*
+         * get the smallest projected value
+         *
+         * @return: smallest value
+         * @complexity: O(N)
+         */
+        template <typename It, typename Proj>
+        typename projected<Proj, It>::type min(It first, It last, Proj proj)
+        {
+            typename projected<Proj, It>::type res = proj(*first);
+            for (++first; first != last; ++first) {
+                typename projected<Proj, It>::type v = proj(*first);
+                if (v < res) res = v;
+            }
+            return res;
+        }
+
+        /*
+         * get the largest projected value
+         *
+         * @return: largest value
+         * @complexity: O(N)
+         */
+        template <typename It, typename Proj>
+        typename projected<Proj, It>::type max(It first, It last, Proj proj)
+        {
+            typename projected<Proj, It>::type res = proj(*first);
+            for (++first; first != last; ++first) {
+                typename projected<Proj, It>::type v = proj(*first);
+                if (res < v) res = v;
+            }
+            return res;
+        }
+
+        /*
+         * get the @k-th smallest projected value keeping a bounded heap of
+         * the @k+1 smallest values seen so far
+         *
+         * @n: number of elements in the range
+         * @k: 0-based index of the value to return
+         *
+         * @return: the @k-th smallest value
+         * @complexity: O(N*log(k))
+         */
+        template <typename It, typename Proj, typename Size>
+        typename projected<Proj, It>::type head(It first, It last, Size n, Size k, Proj proj)
+        {
+            typedef typename projected<Proj, It>::type V;
+            std::less<V> cmp;
+            std::vector<V> heap;
+            heap.reserve(k + 1);
+            for (; first != last; ++first) {
+                V v = proj(*first);
+                if (heap.size() <= k) {
+                    heap.push_back(v);
+                    std::push_heap(heap.begin(), heap.end(), cmp);
+                } else if (v < heap.front()) {
+                    std::pop_heap(heap.begin(), heap.end(), cmp);
+                    heap.back() = v;
+                    std::push_heap(heap.begin(), heap.end(), cmp);
+                }
+            }
+            return heap.front();
+        }
+
+        /*
+         * get the @k-th smallest projected value keeping a bounded heap of
+         * the @n-@k largest values seen so far
+         *
+         * @n: number of elements in the range
+         * @k: 0-based index of the value to return
+         *
+         * @return: the @k-th smallest value
+         * @complexity: O(N*log(N-k))
+         */
+        template <typename It, typename Proj, typename Size>
+        typename projected<Proj, It>::type tail(It first, It last, Size n, Size k, Proj proj)
+        {
+            typedef typename projected<Proj, It>::type V;
+            auto cmp = [](const V& a, const V& b) { return b < a; };
+            Size m = n - k;
+            std::vector<V> heap;
+            heap.reserve(m);
+            for (; first != last; ++first) {
+                V v = proj(*first);
+                if (heap.size() < m) {
+                    heap.push_back(v);
+                    std::push_heap(heap.begin(), heap.end(), cmp);
+                } else if (heap.front() < v) {
+                    std::pop_heap(heap.begin(), heap.end(), cmp);
+                    heap.back() = v;
+                    std::push_heap(heap.begin(), heap.end(), cmp);
+                }
+            }
+            return heap.front();
+        }
+
+        /*
+         * get the @k-th smallest projected value by copying the values and
+         * running a quickselect on them
+         *
+         * @n: number of elements in the range
+         * @k: 0-based index of the value to return
+         *
+         * @return: the @k-th smallest value
+         * @complexity: O(N+N^2) worst case
+         *              O(2*N) average case
+         */
+        template <typename It, typename Proj, typename Size>
+        typename projected<Proj, It>::type nth(It first, It last, Size n, Size k, Proj proj,
+                std::false_type)
+        {
+            typedef typename projected<Proj, It>::type V;
+            std::vector<V> v;
+            v.reserve(n);
+            std::transform(first, last, std::back_inserter(v), proj);
+            std::nth_element(v.begin(), v.begin() + k, v.end());
+            return v[k];
+        }
+
+        /*
+         * @COUNTING_RANGE: value ranges up to which a dense counting array is
+         *                  always used, whatever the number of elements
+         * @RADIX_BITS: number of bits per radix selection pass
+         * @RADIX_MAX_PASSES: beyond this number of passes, radix selection is
+         *                    slower than copy + quickselect
+         */
+        enum { COUNTING_RANGE = 1 << 16, RADIX_BITS = 11, RADIX_MAX_PASSES = 3 };
+
+        /*
+         * shift an unsigned value right, shifting by the type width or more
+         * giving 0 instead of being undefined
+         *
+         * @u: value to shift
+         * @shift: number of bits
+         *
+         * @return: u >> shift
+         */
+        template <typename U>
+        U shift_right(U u, int shift)
+        {
+            return shift < std::numeric_limits<U>::digits ? u >> shift : 0;
+        }
+
+        /*
+         * get the @k-th smallest projected value, for integral values
+         * After a min/max scan, values are ranked without comparison and
+         * without copy:
+         *  - when the range of values is small, with a dense counting array
+         *    (1 more pass)
+         *  - otherwise, with a most-significant-digit radix selection, one
+         *    pass per RADIX_BITS bits of the range
+         * If the range is too wide for the radix selection to pay off, it
+         * falls back to copy + quickselect
+         *
+         * @n: number of elements in the range
+         * @k: 0-based index of the value to return
+         *
+         * @return: the @k-th smallest value
+         * @complexity: O(N)
+         */
+        template <typename It, typename Proj, typename Size>
+        typename projected<Proj, It>::type counting(It first, It last, Size n, Size k, Proj proj)
+        {
+            typedef typename projected<Proj, It>::type V;
+            typedef typename std::make_unsigned<V>::type U;
+
+            V lo = proj(*first), hi = lo;
+            for (It it = first; it != last; ++it) {
+                V v = proj(*it);
+                if (v < lo) lo = v;
+                if (hi < v) hi = v;
+            }
+            /* unsigned arithmetic is modular: this is also valid for signed values */
+            U range = U(hi) - U(lo);
+
+            if (range < COUNTING_RANGE || range < n / 4) {
+                std::vector<Size> counts(size_t(range) + 1);
+                for (It it = first; it != last; ++it) {
+                    ++counts[U(U(proj(*it)) - U(lo))];
+                }
+                U i = 0;
+                while (k >= counts[i]) k -= counts[i++];
+                return V(U(lo) + i);
+            }
+
+            int bits = 0;
+            while (shift_right(range, bits)) ++bits;
+            int passes = (bits + RADIX_BITS - 1) / RADIX_BITS;
+            if (passes > RADIX_MAX_PASSES) return nth(first, last, n, k, proj, std::false_type());
+
+            /*
+             * @prefix: the high digits of the result selected so far
+             * @counts: the last slot counts the elements not matching @prefix,
+             *          so that counting is branch-free
+             */
+            U prefix = 0;
+            std::vector<Size> counts((1 << RADIX_BITS) + 1);
+            for (int shift = (passes - 1) * RADIX_BITS; shift >= 0; shift -= RADIX_BITS) {
+                std::fill(counts.begin(), counts.end(), 0);
+                for (It it = first; it != last; ++it) {
+                    U key = U(U(proj(*it)) - U(lo));
+                    bool match = shift_right(key, shift + RADIX_BITS) == prefix;
+                    ++counts[match ? (key >> shift) & ((1 << RADIX_BITS) - 1) : 1 << RADIX_BITS];
+                }
+                U digit = 0;
+                for (; k >= counts[digit]; ++digit) k -= counts[digit];
+                prefix = (prefix << RADIX_BITS) | digit;
+            }
+            return V(U(lo) + prefix);
+        }
+
+        /*
+         * @is_integral: true for integral types except bool, which are
+         *               selected by counting instead of comparison
+         */
+        template <typename V>
+        struct is_integral
+            : std::integral_constant<bool, std::is_integral<V>::value && !std::is_same<V, bool>::value> {};
+
+        /*
+         * get the @k-th smallest projected value, with counting() for
+         * integral values and copy + quickselect otherwise
+         *
+         * @n: number of elements in the range
+         * @k: 0-based index of the value to return
+         *
+         * @return: the @k-th smallest value
+         */
+        template <typename It, typename Proj, typename Size>
+        typename projected<Proj, It>::type nth(It first, It last, Size n, Size k, Proj proj,
+                std::true_type)
+        {
+            return counting(first, last, n, k, proj);
+        }
+
+        template <typename It, typename Proj, typename Size>
+        typename projected<Proj, It>::type nth(It first, It last, Size n, Size k, Proj proj)
+        {
+            return nth(first, last, n, k, proj, is_integral<typename projected<Proj, It>::type>());
+        }
+
+        /*
+         * @S: strategy
+         * @strategy_tag: tag type for dispatching on a strategy at compile time
+         */
+        template <Strategy S>
+        using strategy_tag = std::integral_constant<Strategy, S>;
+
+        /*
+         * get the @k-th smallest projected value with a given strategy
+         *
+         * @n: number of elements in the range
+         * @k: 0-based index of the value to return
+         *
+         * @return: the @k-th smallest value
+         */
+        template <typename It, typename Proj, typename Size>
+        typename projected<Proj, It>::type kth(It first, It last, Size, Size, Proj proj,
+                strategy_tag<MIN>)
+        {
+            return select::min(first, last, proj);
+        }
+
+        template <typename It, typename Proj, typename Size>
+        typename projected<Proj, It>::type kth(It first, It last, Size, Size, Proj proj,
+                strategy_tag<MAX>)
+        {
+            return select::max(first, last, proj);
+        }
+
+        template <typename It, typename Proj, typename Size>
+        typename projected<Proj, It>::type kth(It first, It last, Size n, Size k, Proj proj,
+                strategy_tag<HEAD>)
+        {
+            return select::head(first, last, n, k, proj);
+        }
+
+        template <typename It, typename Proj, typename Size>
+        typename projected<Proj, It>::type kth(It first, It last, Size n, Size k, Proj proj,
+                strategy_tag<TAIL>)
+        {
+            return select::tail(first, last, n, k, proj);
+        }
+
+        template <typename It, typename Proj, typename Size>
+        typename projected<Proj, It>::type kth(It first, It last, Size n, Size k, Proj proj,
+                strategy_tag<NTH>)
+        {
+            return select::nth(first, last, n, k, proj);
+        }
+
+        /*
+         * get the percentile num/den of a range, the algorithm being chosen
+         * at run time
+         *
+         * @n: number of elements in the range
+         * @num, @den: percentile in % as a rational
+         *
+         * @return: percentile
+         */
+        template <typename It, typename Proj, typename Size>
+        typename projected<Proj, It>::type percentile(It first, It last, Size n,
+                std::intmax_t num, std::intmax_t den, Proj proj)
+        {
+            Size k = index(n, num, den);
+            switch (strategy(num, den)) {
+                case MIN:
+                    return kth(first, last, n, k, proj, strategy_tag<MIN>());
+                case MAX:
+                    return kth(first, last, n, k, proj, strategy_tag<MAX>());
+                case HEAD:
+                    return kth(first, last, n, k, proj, strategy_tag<HEAD>());
+                case TAIL:
+                    return kth(first, last, n, k, proj, strategy_tag<TAIL>());
+                default:
+                    return kth(first, last, n, k, proj, strategy_tag<NTH>());
+            }
+        }
+
+        /*
+         * get the percentile P of a range, the algorithm being chosen at
+         * compile time: only the selected algorithm is instantiated
+         *
+         * @P: percentile in % as a std::ratio<>
+         * @n: number of elements in the range
+         *
+         * @return: percentile
+         */
+        template <typename P, typename It, typename Proj, typename Size>
+        typename projected<Proj, It>::type percentile(It first, It last, Size n, Proj proj)
+        {
+            static_assert(P::num >= 0 && P::num <= 100 * P::den, "percentile must be in [0, 100]");
+            return kth(first, last, n, index(n, P::num, P::den), proj,
+                    strategy_tag<strategy(P::num, P::den)>());
+        }
+
+    }
+
+}
+
+#endif  /* FR_BENOU_STATS_SELECT_H_ */
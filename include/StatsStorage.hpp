@@ -0,0 +1,273 @@
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifndef FR_BENOU_STATS_STORAGE_H_
+#define FR_BENOU_STATS_STORAGE_H_
+
+namespace fr_benou {
+
+    /*
+     * Stats storages
+     * A storage defines how the values of a bucket (ie of a single
+     * timestamp) are laid out in memory, see the STORAGE template parameter
+     * of Stats. It provides a Bucket<TS, V> class template with:
+     *
+     * @value_type: std::pair<TS, V>
+     * @const_iterator, @const_reverse_iterator: iterators over the
+     *                                           (timestamp, value) pairs
+     * @value_iterator: iterator over the values only
+     * @ts(): timestamp of the values, the bucket must not be empty
+     * @back_value(): the last value, the bucket must not be empty
+     * @emplace(ts, args...): construct a value at the end
+     * @replace(i, val): replace the i-th value
+     * @evict(i): move the last value to the i-th place, dropping the i-th
+     *            value (i being the last index simply drops the last one)
+     * @memory(): bytes used by the bucket, storage included
+     * @size(), @empty(), @clear(), @capacity(), @reserve(n), @data()
+     */
+
+    /*
+     * construct a value at the end of a vector
+     * Aggregates (ie plain records) have no constructor to forward to, so
+     * they are brace-initialized instead
+     */
+    template <typename V, typename... Args>
+    typename std::enable_if<std::is_constructible<V, Args&&...>::value>::type
+    construct_back_(std::vector<V>& values, Args&&... args)
+    {
+        values.emplace_back(std::forward<Args>(args)...);
+    }
+
+    template <typename V, typename... Args>
+    typename std::enable_if<!std::is_constructible<V, Args&&...>::value>::type
+    construct_back_(std::vector<V>& values, Args&&... args)
+    {
+        values.push_back(V{std::forward<Args>(args)...});
+    }
+
+    /*
+     * The default storage: each value is stored along its timestamp, and
+     * iterators yield references to the stored pairs
+     */
+    struct PairStorage {
+        template <typename TS, typename V>
+        class Bucket {
+            public:
+                typedef std::pair<TS, V> value_type;
+                typedef typename std::vector<value_type>::size_type size_type;
+                typedef typename std::vector<value_type>::const_iterator const_iterator;
+                typedef typename std::vector<value_type>::const_reverse_iterator const_reverse_iterator;
+
+                /*
+                 * iterator yielding the second member of the pairs
+                 */
+                struct value_iterator
+                    : public std::iterator<std::forward_iterator_tag, V> {
+                        const_iterator current;
+
+                        explicit value_iterator(const_iterator current) : current(current) {}
+
+                        value_iterator& operator++ ()
+                        {
+                            ++current;
+                            return *this;
+                        }
+
+                        const V& operator* () const
+                        {
+                            return current->second;
+                        }
+
+                        bool operator== (const value_iterator& other) const {
+                            return current == other.current;
+                        }
+
+                        bool operator!= (const value_iterator& other) const {
+                            return current != other.current;
+                        }
+                };
+
+            private:
+                std::vector<value_type> pairs;
+
+            public:
+                size_type size() const { return pairs.size(); }
+                bool empty() const { return pairs.empty(); }
+                void clear() { pairs.clear(); }
+                size_type capacity() const { return pairs.capacity(); }
+                void reserve(size_type n) { pairs.reserve(n); }
+                const void *data() const { return pairs.data(); }
+                std::size_t memory() const { return sizeof(*this) + pairs.capacity() * sizeof(value_type); }
+
+                const_iterator begin() const { return pairs.begin(); }
+                const_iterator end() const { return pairs.end(); }
+                const_reverse_iterator rbegin() const { return pairs.rbegin(); }
+                const_reverse_iterator rend() const { return pairs.rend(); }
+                value_iterator values_begin() const { return value_iterator(pairs.begin()); }
+                value_iterator values_end() const { return value_iterator(pairs.end()); }
+
+                TS ts() const { return pairs.front().first; }
+                const V& back_value() const { return pairs.back().second; }
+
+                template <typename... Args>
+                void emplace(TS ts, Args&&... args)
+                {
+                    emplace_(std::is_constructible<V, Args&&...>(), ts, std::forward<Args>(args)...);
+                }
+
+                void replace(size_type i, const V& val)
+                {
+                    pairs[i].second = val;
+                }
+
+                void evict(size_type i)
+                {
+                    if (i + 1 != pairs.size()) pairs[i] = std::move(pairs.back());
+                    pairs.pop_back();
+                }
+
+            private:
+                template <typename... Args>
+                void emplace_(std::true_type, TS ts, Args&&... args)
+                {
+                    pairs.emplace_back(std::piecewise_construct,
+                            std::forward_as_tuple(ts), std::forward_as_tuple(std::forward<Args>(args)...));
+                }
+
+                template <typename... Args>
+                void emplace_(std::false_type, TS ts, Args&&... args)
+                {
+                    pairs.emplace_back(ts, V{std::forward<Args>(args)...});
+                }
+        };
+    };
+
+    /*
+     * Compact storage: as all the values of a bucket share the same
+     * timestamp, it is stored once per bucket, and only the values are
+     * stored per element. For instance, a float takes 4 bytes instead of 16
+     * for a std::pair<std::uint64_t, float>.
+     * Iterators rebuild the (timestamp, value) pairs on the fly, and thus
+     * yield them by value.
+     */
+    struct CompactStorage {
+        template <typename TS, typename V>
+        class Bucket {
+            public:
+                typedef std::pair<TS, V> value_type;
+                typedef typename std::vector<V>::size_type size_type;
+                typedef typename std::vector<V>::const_iterator value_iterator;
+
+            private:
+                /*
+                 * iterator over the values, yielding (timestamp, value)
+                 * pairs, going backward when REVERSE
+                 * A reverse iterator points right after its element
+                 */
+                template <bool REVERSE>
+                class iterator_
+                    : public std::iterator<std::bidirectional_iterator_tag, value_type,
+                            std::ptrdiff_t, const value_type*, value_type> {
+                    private:
+                        TS ts;
+                        const V *p;
+
+                    public:
+                        /*
+                         * result of operator->, holding the rebuilt pair
+                         */
+                        struct arrow {
+                            value_type pair;
+                            const value_type* operator-> () const { return &pair; }
+                        };
+
+                        iterator_() : ts(), p(NULL) {}
+                        iterator_(TS ts, const V *p) : ts(ts), p(p) {}
+
+                        value_type operator* () const
+                        {
+                            return value_type(ts, REVERSE ? *(p - 1) : *p);
+                        }
+
+                        arrow operator-> () const
+                        {
+                            return arrow{**this};
+                        }
+
+                        iterator_& operator++ ()
+                        {
+                            if (REVERSE) --p; else ++p;
+                            return *this;
+                        }
+
+                        iterator_& operator-- ()
+                        {
+                            if (REVERSE) ++p; else --p;
+                            return *this;
+                        }
+
+                        bool operator== (const iterator_& other) const {
+                            return p == other.p;
+                        }
+
+                        bool operator!= (const iterator_& other) const {
+                            return p != other.p;
+                        }
+                };
+
+            public:
+                typedef iterator_<false> const_iterator;
+                typedef iterator_<true> const_reverse_iterator;
+
+            private:
+                TS ts_;
+                std::vector<V> values;
+
+            public:
+                Bucket() : ts_() {}
+
+                size_type size() const { return values.size(); }
+                bool empty() const { return values.empty(); }
+                void clear() { values.clear(); }
+                size_type capacity() const { return values.capacity(); }
+                void reserve(size_type n) { values.reserve(n); }
+                const void *data() const { return values.data(); }
+                std::size_t memory() const { return sizeof(*this) + values.capacity() * sizeof(V); }
+
+                const_iterator begin() const { return const_iterator(ts_, values.data()); }
+                const_iterator end() const { return const_iterator(ts_, values.data() + values.size()); }
+                const_reverse_iterator rbegin() const { return const_reverse_iterator(ts_, values.data() + values.size()); }
+                const_reverse_iterator rend() const { return const_reverse_iterator(ts_, values.data()); }
+                value_iterator values_begin() const { return values.begin(); }
+                value_iterator values_end() const { return values.end(); }
+
+                TS ts() const { return ts_; }
+                const V& back_value() const { return values.back(); }
+
+                template <typename... Args>
+                void emplace(TS ts, Args&&... args)
+                {
+                    ts_ = ts;
+                    construct_back_(values, std::forward<Args>(args)...);
+                }
+
+                void replace(size_type i, const V& val)
+                {
+                    values[i] = val;
+                }
+
+                void evict(size_type i)
+                {
+                    if (i + 1 != values.size()) values[i] = std::move(values.back());
+                    values.pop_back();
+                }
+        };
+    };
+
+}
+
+#endif  /* FR_BENOU_STATS_STORAGE_H_ */
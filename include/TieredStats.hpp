@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include "Stats.hpp"
+#include "QuantileSketch.hpp"
+
+#ifndef FR_BENOU_TIERED_STATS_H_
+#define FR_BENOU_TIERED_STATS_H_
+
+namespace fr_benou {
+
+    /*
+     * TieredStats: exact values for the newest seconds, sketches for the
+     * older ones
+     * The HOT newest seconds are stored as raw values in a Stats. When a
+     * second leaves the hot tier, its values are summarized in a
+     * QuantileSketch, kept until the second leaves the TIMEOUT window.
+     * Memory is thus O(values of HOT seconds) + O(bins * TIMEOUT) instead of
+     * O(values of TIMEOUT seconds).
+     * Percentiles are exact as long as all the values are in the hot tier,
+     * and within the sketches relative accuracy otherwise: get_p() reports
+     * the error bound along the value.
+     *
+     * Template parameters:
+     * @T: the value type, convertible to double
+     * @TIMEOUT: max lifetime for values
+     * @HOT: number of seconds kept exact, less than TIMEOUT
+     * @GETTIMESTAMP: Callable functor returning the current timestamp when called
+     */
+    template <typename T=double, int TIMEOUT=60, int HOT=5, typename GETTIMESTAMP=GetTimestamp>
+    class TieredStats {
+        static_assert(HOT > 0 && HOT < TIMEOUT, "the hot tier must be shorter than the window");
+
+        /*
+         * @timestamp_type: timestamp values type
+         * @value_type: stored values type
+         * @size_type: a type large enough to count all stored elements
+         * @Estimate: a percentile and its absolute error bound, 0 when the
+         *            percentile is exact
+         */
+        public:
+            typedef typename GETTIMESTAMP::timestamp_type timestamp_type;
+            typedef T value_type;
+            typedef QuantileSketch::count_type size_type;
+            struct Estimate {
+                double value;
+                double error;
+            };
+
+        /*
+         * @Cold: the sketch of a second of the cold tier
+         * @ColdIndex: Stats index moving the expired hot buckets to the cold
+         *             tier
+         * @alpha: sketches relative accuracy
+         * @newest: newest timestamp added
+         * @cold: cold tier, indexed by timestamp % TIMEOUT
+         * @hot: hot tier
+         */
+        private:
+            struct Cold {
+                timestamp_type ts;
+                QuantileSketch sketch;
+            };
+
+            struct ColdIndex {
+                TieredStats *tiered;
+
+                template <typename V>
+                void insert(timestamp_type, const V&) {}
+
+                template <typename It>
+                void seal(timestamp_type, It, It) {}
+
+                template <typename It>
+                void expire(timestamp_type ts, It first, It last)
+                {
+                    for (; first != last; ++first) tiered->cold_(ts).add(double(*first));
+                }
+
+                void clear() {}
+            };
+
+            double alpha;
+            timestamp_type newest;
+            std::vector<Cold> cold;
+            Stats<T, HOT, GETTIMESTAMP, ColdIndex> hot;
+
+            /*
+             * get the sketch of a cold second, resetting its slot if it
+             * was used by an older second
+             *
+             * @ts: timestamp
+             *
+             * @return: sketch
+             */
+            QuantileSketch& cold_(timestamp_type ts)
+            {
+                Cold& slot = cold[ts % TIMEOUT];
+                if (slot.ts != ts) {
+                    slot.ts = ts;
+                    slot.sketch.clear();
+                }
+                return slot.sketch;
+            }
+
+            /*
+             * @return: true if the cold slot holds a second of the window
+             */
+            bool valid_(const Cold& slot) const
+            {
+                return !slot.sketch.empty() && slot.ts + TIMEOUT > newest && slot.ts + HOT <= newest;
+            }
+
+        public:
+            /*
+             * @alpha: relative accuracy of the cold tier
+             */
+            explicit TieredStats(double alpha = 0.01)
+                : alpha(alpha), newest(0), cold(TIMEOUT, Cold{0, QuantileSketch(alpha)}),
+                hot(ColdIndex{this})
+            {
+            }
+
+            /*
+             * the hot tier index points to this object
+             */
+            TieredStats(const TieredStats&) = delete;
+            TieredStats& operator= (const TieredStats&) = delete;
+
+            /*
+             * add a new (timestamp, value) pair
+             * Late values going directly to the cold tier are summarized
+             * right away
+             *
+             * @ts: timestamp
+             * @val: value
+             *
+             * @return: TieredStats
+             * @complexity: O(1) (amortized)
+             */
+            TieredStats& add(timestamp_type ts, value_type val)
+            {
+                if (ts > newest) newest = ts;
+                if (ts + HOT > newest) {
+                    hot.add(ts, val);
+                } else if (ts + TIMEOUT > newest) {
+                    cold_(ts).add(double(val));
+                }
+                return *this;
+            }
+
+            /*
+             * add a new value, automatically timestamping it with current
+             * timestamp
+             *
+             * @val: value
+             *
+             * @return: TieredStats
+             * @complexity: O(1) (amortized)
+             */
+            TieredStats& add(value_type val)
+            {
+                return add(GETTIMESTAMP()(), val);
+            }
+
+            /*
+             * get the number of valid elements, in both tiers
+             *
+             * @return: number of elements
+             * @complexity: O(TIMEOUT)
+             */
+            size_type size() const
+            {
+                size_type sz = hot.size();
+                for (const Cold& slot : cold) {
+                    if (valid_(slot)) sz += slot.sketch.size();
+                }
+                return sz;
+            }
+
+            void clear()
+            {
+                hot.clear();
+                for (Cold& slot : cold) slot.sketch.clear();
+                newest = 0;
+            }
+
+            /*
+             * get the percentile of valid elements
+             * The hot values are sorted and merged with the bins of the cold
+             * sketches. As every cold value x is estimated within
+             * alpha * |x|, so is the percentile, hence an error bound of
+             * alpha / (1 - alpha) times the estimated percentile.
+             *
+             * @p: percentile in % (ie 50 means median)
+             *
+             * @return: percentile and error bound
+             * @throw: std::out_of_range when empty or @p is not in [0, 100]
+             * @complexity: O(H*log(H) + bins*TIMEOUT), H being the number of
+             *              hot values. O(H) when the cold tier is empty
+             */
+            Estimate get_p(int p) const
+            {
+                if (p < 0 || p > 100) throw std::out_of_range("percentile must be in [0, 100]");
+                QuantileSketch merged(alpha);
+                for (const Cold& slot : cold) {
+                    if (valid_(slot)) merged.merge(slot.sketch);
+                }
+                if (merged.empty()) return Estimate{double(hot.get_p(p)), 0};
+
+                std::vector<double> values;
+                values.reserve(hot.size());
+                for (const auto& sp : hot) values.push_back(double(sp.second));
+                std::sort(values.begin(), values.end());
+
+                size_type k = select::index(values.size() + merged.size(), p, 1);
+                size_type rank = 0;
+                double value = 0;
+                std::vector<QuantileSketch::Bin> bins = merged.bins();
+                auto hv = values.begin();
+                auto bin = bins.begin();
+                while (rank <= k) {
+                    if (bin == bins.end() || (hv != values.end() && *hv <= bin->first)) {
+                        value = *hv++;
+                        ++rank;
+                    } else {
+                        value = bin->first;
+                        rank += bin->second;
+                        ++bin;
+                    }
+                }
+                return Estimate{value, alpha / (1 - alpha) * std::fabs(value)};
+            }
+
+            /*
+             * get the 70-percentile of valid elements
+             *
+             * @return: 70-percentile and error bound
+             * @throw: std::out_of_range when empty
+             */
+            Estimate get_p70() const
+            {
+                return get_p(70);
+            }
+    };
+
+}
+
+#endif  /* FR_BENOU_TIERED_STATS_H_ */
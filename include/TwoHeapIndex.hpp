@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <cstddef>
+#include <ratio>
+#include <stdexcept>
+#include <vector>
+#include "Stats.hpp"
+
+#ifndef FR_BENOU_TWO_HEAP_INDEX_H_
+#define FR_BENOU_TWO_HEAP_INDEX_H_
+
+namespace fr_benou {
+
+    /*
+     * Stats index maintaining a single percentile, for series read far more
+     * often than written: the values of the window are split into a max-heap
+     * of the values up to the percentile and a min-heap of the values above
+     * it, so that the percentile is the top of the first heap:
+     *     Stats<double, 60, GetTimestamp, TwoHeapIndex<double, 70, 60>> stats;
+     *     double p70 = stats.get_p70();  // O(1)
+     *
+     * Expired values are not searched in the heaps: each second counts its
+     * values in both heaps, so that an expiring second only updates the
+     * counts, and its values are dropped when they reach the top of a heap
+     * (lazy deletion). Heaps are compacted when expired values outnumber the
+     * valid ones.
+     * add() becomes O(log N) amortized. Other percentiles are still computed
+     * from the values.
+     *
+     * Template parameters:
+     * @T: the value type, ordered by operator<
+     * @P: the percentile in %
+     * @TIMEOUT: the Stats timeout, in seconds
+     * @TS: the timestamp type
+     */
+    template <typename T, int P=70, int TIMEOUT=60, typename TS=GetTimestamp::timestamp_type>
+    class TwoHeapIndex {
+        static_assert(P >= 0 && P <= 100, "percentile must be in [0, 100]");
+
+        /*
+         * @percentile_type: the maintained percentile, as a std::ratio<>
+         */
+        public:
+            typedef std::ratio<P> percentile_type;
+
+        /*
+         * @Entry: a value and its timestamp
+         * @Lower, @Upper: heap orderings, the largest (smallest) value on top
+         * @Second: number of values of a second in each heap
+         * @lower: the values up to the percentile, in a max-heap
+         * @upper: the values above the percentile, in a min-heap
+         * @lower_count, @upper_count: number of valid values in each heap
+         * @horizon: values older than it expired
+         * @seconds: per-second counts, indexed by timestamp % TIMEOUT
+         */
+        private:
+            struct Entry {
+                T value;
+                TS ts;
+            };
+
+            struct Lower {
+                bool operator() (const Entry& a, const Entry& b) const { return a.value < b.value; }
+            };
+
+            struct Upper {
+                bool operator() (const Entry& a, const Entry& b) const { return b.value < a.value; }
+            };
+
+            struct Second {
+                TS ts;
+                std::size_t lower;
+                std::size_t upper;
+            };
+
+            std::vector<Entry> lower;
+            std::vector<Entry> upper;
+            std::size_t lower_count;
+            std::size_t upper_count;
+            TS horizon;
+            Second seconds[TIMEOUT];
+
+            /*
+             * drop the expired values from the top of a heap, and compact it
+             * when they are the majority
+             *
+             * @heap: heap to clean
+             * @valid: number of valid values in @heap
+             *
+             * @return: None
+             * @complexity: O(log N) amortized
+             */
+            template <typename Cmp>
+            void prune_(std::vector<Entry>& heap, std::size_t valid)
+            {
+                TS h = horizon;
+                while (!heap.empty() && heap.front().ts < h) {
+                    std::pop_heap(heap.begin(), heap.end(), Cmp());
+                    heap.pop_back();
+                }
+                if (heap.size() > 2 * valid + 64) {
+                    heap.erase(std::remove_if(heap.begin(), heap.end(),
+                                [h](const Entry& e) { return e.ts < h; }), heap.end());
+                    std::make_heap(heap.begin(), heap.end(), Cmp());
+                }
+            }
+
+            /*
+             * move the top value of a heap to the other one
+             *
+             * @from, @to: heaps
+             * @from_count, @to_count: number of valid values of the heaps
+             * @from_second, @to_second: per-second counts of the heaps
+             *
+             * @return: None
+             * @complexity: O(log N)
+             */
+            template <typename FromCmp, typename ToCmp>
+            void move_(std::vector<Entry>& from, std::vector<Entry>& to,
+                    std::size_t& from_count, std::size_t& to_count,
+                    std::size_t Second::* from_second, std::size_t Second::* to_second)
+            {
+                Entry e = from.front();
+                std::pop_heap(from.begin(), from.end(), FromCmp());
+                from.pop_back();
+                to.push_back(e);
+                std::push_heap(to.begin(), to.end(), ToCmp());
+                Second& second = seconds[e.ts % TIMEOUT];
+                --(second.*from_second);
+                ++(second.*to_second);
+                --from_count;
+                ++to_count;
+            }
+
+            /*
+             * move values between the heaps so that the lower one holds the
+             * valid values up to the percentile rank
+             *
+             * @complexity: O(log N) amortized
+             */
+            void balance_()
+            {
+                prune_<Lower>(lower, lower_count);
+                prune_<Upper>(upper, upper_count);
+                std::size_t n = lower_count + upper_count;
+                if (0 == n) return;
+                std::size_t target = select::index(n, P, 1) + 1;
+                while (lower_count > target) {
+                    move_<Lower, Upper>(lower, upper, lower_count, upper_count, &Second::lower, &Second::upper);
+                    prune_<Lower>(lower, lower_count);
+                }
+                while (lower_count < target) {
+                    move_<Upper, Lower>(upper, lower, upper_count, lower_count, &Second::upper, &Second::lower);
+                    prune_<Upper>(upper, upper_count);
+                }
+            }
+
+        public:
+            TwoHeapIndex()
+            {
+                clear();
+            }
+
+            void insert(TS ts, const T& val)
+            {
+                Second& second = seconds[ts % TIMEOUT];
+                if (second.ts != ts) {
+                    second.ts = ts;
+                    second.lower = 0;
+                    second.upper = 0;
+                }
+                if (lower_count && !(lower.front().value < val)) {
+                    lower.push_back(Entry{val, ts});
+                    std::push_heap(lower.begin(), lower.end(), Lower());
+                    ++second.lower;
+                    ++lower_count;
+                } else {
+                    upper.push_back(Entry{val, ts});
+                    std::push_heap(upper.begin(), upper.end(), Upper());
+                    ++second.upper;
+                    ++upper_count;
+                }
+                balance_();
+            }
+
+            template <typename It>
+            void seal(TS, It, It) {}
+
+            template <typename It>
+            void expire(TS ts, It, It)
+            {
+                /* after a long gap, the slot may hold an older second */
+                Second& second = seconds[ts % TIMEOUT];
+                if (second.ts <= ts) {
+                    lower_count -= second.lower;
+                    upper_count -= second.upper;
+                    second.lower = 0;
+                    second.upper = 0;
+                }
+                if (ts >= horizon) horizon = ts + 1;
+                balance_();
+            }
+
+            void clear()
+            {
+                lower.clear();
+                upper.clear();
+                lower_count = 0;
+                upper_count = 0;
+                horizon = 0;
+                for (int i=0; i<TIMEOUT; ++i) {
+                    seconds[i].ts = 0;
+                    seconds[i].lower = 0;
+                    seconds[i].upper = 0;
+                }
+            }
+
+            /*
+             * get the maintained percentile of the window
+             *
+             * @return: percentile
+             * @throw: std::out_of_range when the window is empty
+             * @complexity: O(1)
+             */
+            T percentile() const
+            {
+                if (0 == lower_count) throw std::out_of_range("TwoHeapIndex is empty");
+                return lower.front().value;
+            }
+    };
+
+}
+
+#endif  /* FR_BENOU_TWO_HEAP_INDEX_H_ */
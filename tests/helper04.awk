@@ -0,0 +1,117 @@
+# Check examples/replay output against percentiles computed from the input
+# Usage: awk -f helper04.awk input replay_output
+
+# insertion sort is good enough for the test sizes
+function sort(v, n,    i, j, x) {
+    for (i=2; i<=n; i++) {
+        x=v[i]
+        for (j=i-1; j>=1 && v[j]>x; j--) v[j+1]=v[j]
+        v[j+1]=x
+    }
+}
+
+# 0-based index of the p-percentile in n sorted values
+function index_p(n, p,    k) {
+    k=int((n * p * 10 + 999) / 1000)
+    return k >= n ? n - 1 : k
+}
+
+BEGIN{
+    TIMEOUT=60
+}
+FNR==NR{
+    ts[NR]=$1; val[NR]=$2; n_in=NR
+    sec[$1]=sec[$1] " " $2
+    per_sec[$1]++
+    if ($1 > max) max=$1
+    next
+}
+FNR==1{
+    sum=0; count=0
+    for (i=1; i<=n_in; i++) if (ts[i] > max - 10) { sum+=val[i]; count++ }
+    mean10=sprintf("%.6g", sum / count)
+    n=0
+    for (i=1; i<=n_in; i++) if (ts[i] > max - TIMEOUT) v[++n]=val[i]
+    for (i=1; i<=n; i++) last[i]=v[i]
+    for (i=1; i<=n_in; i++) a[i]=val[i]
+    sort(a, n_in)
+    sort(v, n)
+    for (t in sec) if (t != max) n_sec++
+    if ($1 != "size") { print "bad size " $0; exit 1 }
+    for (i=2; i<=NF; i++) {
+        if ($i != n) { print "bad size " $0 " expected " n; exit 1 }
+    }
+    next
+}
+$1=="all"{
+    if ($2 != n_in || $3 != a[1] || $4 != a[index_p(n_in, 70)+1] || $5 != a[n_in]) {
+        print "bad all " $0; exit 4
+    }
+    done=1
+    next
+}
+$1=="min" || $1=="max"{
+    x=$1=="min" ? v[1] : v[n]
+    for (i=2; i<=NF; i++) {
+        if ($i != x) { print "bad " $1 ": " $i " expected " x; exit 5 }
+    }
+    next
+}
+$1=="mean10"{
+    for (i=2; i<=NF; i++) {
+        if ($i != mean10) { print "bad " $1 ": " $i " expected " mean10; exit 6 }
+    }
+    next
+}
+$1=="h"{
+    # every second but the newest one is sealed
+    if ($2 == max || !($2 in sec)) { print "bad " $0; exit 7 }
+    if ($2 <= prev_h) { print "bad history order " $0; exit 7 }
+    prev_h=$2; n_h++
+    m=split(substr(sec[$2], 2), s, " ")
+    sort(s, m)
+    split("0 50 70 100", hp, " ")
+    for (i=3; i<=NF; i++) {
+        k=index_p(m, hp[i-2])
+        if ($i != s[k+1]) { print "bad " $0 ": p" hp[i-2] " expected " s[k+1]; exit 7 }
+    }
+    next
+}
+$1=="sampled"{
+    # each second keeps at most 30 values, percentiles are only estimated
+    stored=0
+    for (t in per_sec) if (t > max - TIMEOUT) stored+=per_sec[t] < 30 ? per_sec[t] : 30
+    rate=sprintf("%.6g", stored / n)
+    if ($2 != rate || $3 != stored) { print "bad " $0 ": expected " rate " " stored; exit 10 }
+    d=$4 - v[index_p(n, 50)+1]
+    if (d < -50 || d > 50) { print "bad sampled p50 " $0; exit 10 }
+    d=$5 - v[index_p(n, 99)+1]
+    if (d < -50 || d > 50) { print "bad sampled p99 " $0; exit 10 }
+    next
+}
+$1=="tiered"{
+    x=v[index_p(n, $2)+1]
+    d=$3 - x
+    if (d < 0) d=-d
+    if (d > $4 + 0.001) { print "bad " $0 ": expected " x; exit 9 }
+    next
+}
+$1=="mismatches"{
+    if ($2 != 0) { print "bad " $0; exit 5 }
+    next
+}
+$1=="last"{
+    for (i=2; i<=NF; i++) {
+        if ($i != last[n - NF + i]) { print "bad last " $0; exit 3 }
+    }
+    next
+}
+{
+    k=index_p(n, substr($1, 2))
+    for (i=2; i<=NF; i++) {
+        if ($i != v[k+1]) { print "bad " $1 ": " $i " expected " v[k+1]; exit 2 }
+    }
+}
+END{
+    if (done && n_h != n_sec) { print "bad history size " n_h " expected " n_sec; exit 8 }
+}